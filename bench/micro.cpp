@@ -0,0 +1,379 @@
+// Microbenchmarks for the steps that scale with the session: parsing replies, making apps, reconciling and building rows.
+// Each runs over N clients with the complexity fitted, so a step that went quadratic stands out.
+// Payloads are the fixtures in bench/fixtures repeated out to N with fresh addresses and pids. The fixtures are synthetic,
+// shaped like what hyprland replies with, fields we don't read included.
+// Run e.g. ./bench/hyprshutdown-bench-micro --benchmark_filter=Reconcile
+
+#include "../src/state/AppState.hpp"
+#include "../src/state/HyprlandIPC.hpp"
+#include "../src/state/IPCTypes.hpp"
+#include "../src/helpers/OS.hpp"
+#include "../src/helpers/Logger.hpp"
+#include "../src/ui/AppListModel.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <format>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef BENCH_FIXTURES
+#define BENCH_FIXTURES "bench/fixtures"
+#endif
+
+struct State::SBenchAccess {
+    // what discovery would hand over for these clients, minus the IPC
+    static void populate(CAppState& state, const std::string& json) {
+        CAppState::SDiscovery found;
+
+        for (const auto& client : HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClient>>(json).value()) {
+            found.clients.emplace_back(HyprlandIPC::parseAddress(client.address), client.pid);
+            found.apps.emplace_back(makeUnique<CApp>(client));
+        }
+
+        CAppState::groupByPid(found.apps);
+
+        // nothing gets closed or signaled
+        state.m_dryRun = true;
+        state.applyDiscovery(std::move(found));
+    }
+
+    static void group(std::vector<UP<CApp>>& apps) {
+        CAppState::groupByPid(apps);
+    }
+
+    // the reconcile after a full j/clients resync, what updateState does without socket2
+    static void resync(CAppState& state, const std::string& json) {
+        if (state.applyClients(json))
+            state.reconcile();
+    }
+
+    // a closewindow event off socket2
+    static void closeWindow(CAppState& state, uint64_t address) {
+        state.removeClient(address);
+        state.reconcile();
+    }
+};
+
+namespace {
+    std::string readFixture(const std::string& name) {
+        std::ifstream     file(std::string{BENCH_FIXTURES} + "/" + name);
+        std::stringstream ss;
+        ss << file.rdbuf();
+
+        if (ss.str().empty())
+            throw std::runtime_error(std::format("missing fixture {}", name));
+
+        return ss.str();
+    }
+
+    // end of the json value starting at pos, strings and nesting included
+    size_t valueEnd(std::string_view json, size_t pos) {
+        int  depth    = 0;
+        bool inString = false;
+
+        for (size_t i = pos; i < json.size(); ++i) {
+            const char C = json[i];
+
+            if (inString) {
+                if (C == '\\')
+                    i++;
+                else if (C == '"') {
+                    inString = false;
+                    if (depth == 0)
+                        return i + 1;
+                }
+                continue;
+            }
+
+            if (C == '"')
+                inString = true;
+            else if (C == '{' || C == '[')
+                depth++;
+            else if (C == '}' || C == ']') {
+                if (depth == 0)
+                    return i;
+                if (--depth == 0)
+                    return i + 1;
+            } else if (depth == 0 && (C == ',' || C == ' ' || C == '\n'))
+                return i;
+        }
+
+        return json.size();
+    }
+
+    // the elements of a top level array
+    std::vector<std::string> splitArray(std::string_view json) {
+        std::vector<std::string> out;
+
+        for (size_t i = json.find('[') + 1; i < json.size(); ++i) {
+            if (json[i] != '{')
+                continue;
+
+            const auto END = valueEnd(json, i);
+            out.emplace_back(json.substr(i, END - i));
+            i = END;
+        }
+
+        return out;
+    }
+
+    // replaces the value of every "key": in json with fn(what was there, nth occurence)
+    void replaceValues(std::string& json, std::string_view key, const std::function<std::string(std::string_view, size_t)>& fn) {
+        const auto NEEDLE = std::format("\"{}\":", key);
+
+        size_t     n = 0;
+        for (size_t pos = json.find(NEEDLE); pos != std::string::npos; pos = json.find(NEEDLE, pos)) {
+            const auto START = json.find_first_not_of(' ', pos + NEEDLE.size());
+            const auto END   = valueEnd(json, START);
+            const auto VALUE = fn(std::string_view{json}.substr(START, END - START), n++);
+
+            json.replace(START, END - START, VALUE);
+            pos = START + VALUE.size();
+        }
+    }
+
+    // j/clients with n clients, cycling through the fixture. Each cycle gets its own pids, so windows of one process stay together.
+    std::string clientsPayload(size_t n) {
+        static const auto CLIENTS = splitArray(readFixture("clients.json"));
+
+        std::string       out = "[";
+        for (size_t i = 0; i < n; ++i) {
+            auto client = CLIENTS[i % CLIENTS.size()];
+
+            replaceValues(client, "address", [i](std::string_view, size_t) { return std::format("\"0x{:x}\"", 0x55d100000000 + i * 0x40); });
+            replaceValues(client, "pid", [i](std::string_view pid, size_t) { return std::to_string(std::stoll(std::string{pid}) + (i / CLIENTS.size()) * 10000); });
+
+            if (i > 0)
+                out += ",";
+            out += client;
+        }
+
+        return out + "]";
+    }
+
+    // j/layers with about n layers, the fixture's monitor repeated
+    std::string layersPayload(size_t n) {
+        static const auto FIXTURE = readFixture("layers.json");
+        // whatever the first monitor maps to
+        static const auto MONITOR = [] {
+            const auto START = FIXTURE.find_first_not_of(" \n", FIXTURE.find(':') + 1);
+            return FIXTURE.substr(START, valueEnd(FIXTURE, START) - START);
+        }();
+        static const auto PER_MONITOR = [] {
+            size_t count   = 0;
+            auto   monitor = MONITOR;
+            replaceValues(monitor, "address", [&count](std::string_view address, size_t) {
+                count++;
+                return std::string{address};
+            });
+            return std::max<size_t>(count, 1);
+        }();
+
+        std::string out     = "{";
+        size_t      address = 0;
+        for (size_t m = 0; m * PER_MONITOR < n; ++m) {
+            auto monitor = MONITOR;
+            replaceValues(monitor, "address", [&address](std::string_view, size_t) { return std::format("\"0x{:x}\"", 0x55d200000000 + address++ * 0x40); });
+
+            if (m > 0)
+                out += ",";
+            out += std::format("\"DP-{}\":{}", m, monitor);
+        }
+
+        return out + "}";
+    }
+
+    std::vector<UP<State::CApp>> clientApps(const std::string& json) {
+        std::vector<UP<State::CApp>> apps;
+        for (const auto& client : HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClient>>(json).value()) {
+            apps.emplace_back(makeUnique<State::CApp>(client));
+        }
+        State::SBenchAccess::group(apps);
+        return apps;
+    }
+
+    void scaling(benchmark::internal::Benchmark* b) {
+        for (const int N : {10, 50, 100, 500, 1000, 5000}) {
+            b->Arg(N);
+        }
+        b->Complexity();
+    }
+};
+
+static void BM_ParseClients(benchmark::State& state) {
+    const auto JSON = clientsPayload(state.range(0));
+
+    for (auto _ : state) {
+        auto clients = HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClient>>(JSON);
+        benchmark::DoNotOptimize(clients);
+    }
+
+    state.SetBytesProcessed(sc<int64_t>(state.iterations() * JSON.size()));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ParseClients)->Apply(scaling);
+
+// what a resync parses, only address and pid
+static void BM_ParseClientRefs(benchmark::State& state) {
+    const auto JSON = clientsPayload(state.range(0));
+
+    for (auto _ : state) {
+        auto clients = HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClientRef>>(JSON);
+        benchmark::DoNotOptimize(clients);
+    }
+
+    state.SetBytesProcessed(sc<int64_t>(state.iterations() * JSON.size()));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ParseClientRefs)->Apply(scaling);
+
+static void BM_ParseLayers(benchmark::State& state) {
+    const auto JSON = layersPayload(state.range(0));
+
+    for (auto _ : state) {
+        auto layers = HyprlandIPC::parse<HyprlandIPC::CHyprLayers>(JSON);
+        benchmark::DoNotOptimize(layers);
+    }
+
+    state.SetBytesProcessed(sc<int64_t>(state.iterations() * JSON.size()));
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ParseLayers)->Apply(scaling);
+
+// and grouping them per process, like discovery does
+static void BM_AppConstruct(benchmark::State& state) {
+    const auto JSON    = clientsPayload(state.range(0));
+    const auto CLIENTS = HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClient>>(JSON).value();
+
+    for (auto _ : state) {
+        std::vector<UP<State::CApp>> apps;
+        apps.reserve(CLIENTS.size());
+        for (const auto& client : CLIENTS) {
+            apps.emplace_back(makeUnique<State::CApp>(client));
+        }
+        State::SBenchAccess::group(apps);
+        benchmark::DoNotOptimize(apps.data());
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_AppConstruct)->Apply(scaling);
+
+// a full resync where nothing changed: parse, reindex and one pass over the apps
+static void BM_ReconcileResync(benchmark::State& state) {
+    const auto      JSON = clientsPayload(state.range(0));
+
+    State::CAppState appState;
+    State::SBenchAccess::populate(appState, JSON);
+
+    for (auto _ : state) {
+        State::SBenchAccess::resync(appState, JSON);
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ReconcileResync)->Apply(scaling);
+
+// one window closing. Over a whole shutdown that's N of these, so anything linear in here is quadratic there.
+static void BM_ReconcileClose(benchmark::State& state) {
+    const auto            JSON = clientsPayload(state.range(0));
+
+    std::vector<uint64_t> addresses;
+    for (const auto& client : HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClientRef>>(JSON).value()) {
+        addresses.emplace_back(HyprlandIPC::parseAddress(client.address));
+    }
+
+    UP<State::CAppState> appState;
+    size_t               next = addresses.size();
+
+    for (auto _ : state) {
+        if (next == addresses.size()) {
+            state.PauseTiming();
+            appState = makeUnique<State::CAppState>();
+            State::SBenchAccess::populate(*appState, JSON);
+            next = 0;
+            state.ResumeTiming();
+        }
+
+        State::SBenchAccess::closeWindow(*appState, addresses[next++]);
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ReconcileClose)->Apply(scaling);
+
+// not over N, this is the machine's process table
+static void BM_ProcSnapshot(benchmark::State& state) {
+    size_t processes = 0;
+
+    for (auto _ : state) {
+        OS::CProcessSnapshot snapshot;
+        processes = snapshot.processes().size();
+        benchmark::DoNotOptimize(snapshot.childrenOf(1).data());
+    }
+
+    state.counters["processes"] = sc<double>(processes);
+}
+BENCHMARK(BM_ProcSnapshot);
+
+// the rows every monitor builds its list from, one per process of the fixture's
+static void BM_RowsBuild(benchmark::State& state) {
+    const auto APPS = clientApps(clientsPayload(state.range(0)));
+
+    for (auto _ : state) {
+        CAppListModel model;
+        model.sync(APPS);
+        benchmark::DoNotOptimize(model.rows().data());
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_RowsBuild)->Apply(scaling);
+
+// same, with a windowless process per app
+static void BM_RowsBuildDistinct(benchmark::State& state) {
+    std::vector<UP<State::CApp>> apps;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        apps.emplace_back(makeUnique<State::CApp>(std::format("bench-app-{}", i), sc<int>(100000 + i)));
+    }
+
+    for (auto _ : state) {
+        CAppListModel model;
+        model.sync(apps);
+        benchmark::DoNotOptimize(model.rows().data());
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_RowsBuildDistinct)->Apply(scaling);
+
+// what every state change costs once the rows exist and nothing moved
+static void BM_RowsResync(benchmark::State& state) {
+    const auto    APPS = clientApps(clientsPayload(state.range(0)));
+
+    CAppListModel model;
+    model.sync(APPS);
+
+    for (auto _ : state) {
+        model.sync(APPS);
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_RowsResync)->Apply(scaling);
+
+int main(int argc, char** argv) {
+    g_logger->setLogLevel(LOG_ERR);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
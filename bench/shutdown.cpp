@@ -0,0 +1,376 @@
+// End to end shutdown benchmark: a fake hyprland serving N windows and layers out of a synthetic
+// process tree, with CAppState driven headlessly against it until every app is gone.
+
+#include "../src/state/AppState.hpp"
+#include "../src/state/HyprlandIPC.hpp"
+#include "../src/state/IPCTypes.hpp"
+#include "../src/state/PollLoop.hpp"
+#include "../src/helpers/Asserts.hpp"
+#include "../src/helpers/Logger.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <ranges>
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <hyprutils/cli/ArgumentParser.hpp>
+
+namespace {
+    struct SConfig {
+        int windows   = 100;
+        int layers    = 4;
+        int children  = 20;
+        int exitDelay = 50; // ms between a SIGTERM and the exit
+        int stubborn  = 0;  // children that only exit on the second SIGTERM
+        int timeout   = 30; // s
+    };
+
+    struct SClient {
+        std::string address;
+        std::string clazz;
+        int64_t     pid = -1;
+    };
+
+    [[noreturn]] void syntheticApp(int exitDelay, bool stubborn) {
+        // SIGTERM is blocked since before the fork, so none can be missed
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGTERM);
+
+        int sig = 0;
+        sigwait(&set, &sig);
+        if (stubborn)
+            sigwait(&set, &sig);
+
+        usleep(exitDelay * 1000);
+        _exit(0);
+    }
+
+    int64_t spawnApp(int exitDelay, bool stubborn) {
+        const auto PID = fork();
+        if (PID == 0)
+            syntheticApp(exitDelay, stubborn);
+        return PID;
+    }
+
+    int listenOn(const std::filesystem::path& path) {
+        const int FD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        sockaddr_un addr = {0};
+        addr.sun_family  = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        if (FD < 0 || bind(FD, rc<sockaddr*>(&addr), SUN_LEN(&addr)) < 0 || listen(FD, 128) < 0)
+            return -1;
+
+        return FD;
+    }
+
+    // answers the handful of requests hyprshutdown makes, and emits closewindow on socket2
+    [[noreturn]] void fakeHyprland(const std::filesystem::path& dir, const SConfig& config, int readyFd) {
+        signal(SIGCHLD, SIG_IGN); // reap the apps as they exit
+        signal(SIGPIPE, SIG_IGN);
+        setpgid(0, 0);
+
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGTERM);
+        sigprocmask(SIG_BLOCK, &set, nullptr);
+
+        std::vector<SClient> clients;
+        clients.reserve(config.windows);
+        for (int i = 0; i < config.windows; ++i) {
+            clients.emplace_back(SClient{
+                .address = std::format("0x{:x}", 0x5000 + i),
+                .clazz   = std::format("bench-window-{}", i),
+                .pid     = spawnApp(config.exitDelay, false),
+            });
+        }
+
+        std::vector<SClient> layers;
+        layers.reserve(config.layers);
+        for (int i = 0; i < config.layers; ++i) {
+            layers.emplace_back(SClient{
+                .address = std::format("0x{:x}", 0x9000 + i),
+                .clazz   = std::format("bench-layer-{}", i),
+                .pid     = spawnApp(config.exitDelay, false),
+            });
+        }
+
+        for (int i = 0; i < config.children; ++i) {
+            spawnApp(config.exitDelay, i < config.stubborn);
+        }
+
+        const int REQUESTS = listenOn(dir / ".socket.sock");
+        const int EVENTS   = listenOn(dir / ".socket2.sock");
+        if (REQUESTS < 0 || EVENTS < 0)
+            _exit(1);
+
+        write(readyFd, "1", 1);
+        close(readyFd);
+
+        std::vector<int> subscribers;
+
+        const auto       closeWindow = [&](std::string_view address) -> std::string {
+            const auto IT = std::ranges::find(clients, address, &SClient::address);
+            if (IT == clients.end())
+                return "No such window found";
+
+            for (const auto& fd : subscribers) {
+                const auto EVENT = std::format("closewindow>>{}\n", address.substr(2));
+                write(fd, EVENT.c_str(), EVENT.size());
+            }
+
+            kill(IT->pid, SIGTERM);
+            clients.erase(IT);
+            return "ok";
+        };
+
+        const auto handle = [&](std::string_view cmd) -> std::string {
+            if (cmd.starts_with('/'))
+                cmd.remove_prefix(1);
+
+            if (cmd == "j/clients") {
+                std::vector<HyprlandIPC::SHyprClient> out;
+                for (const auto& c : clients) {
+                    out.emplace_back(HyprlandIPC::SHyprClient{.address = c.address, .title = c.clazz, .clazz = c.clazz, .pid = c.pid});
+                }
+                return glz::write_json(out).value_or("[]");
+            }
+
+            if (cmd == "j/layers") {
+                HyprlandIPC::CHyprLayers out;
+                auto&                    level = out["BENCH-1"].levels["2"];
+                for (const auto& l : layers) {
+                    level.emplace_back(HyprlandIPC::SHyprLayer{.address = l.address, .ns = l.clazz, .pid = l.pid});
+                }
+                return glz::write_json(out).value_or("{}");
+            }
+
+            constexpr std::string_view CLOSE = "dispatch closewindow address:";
+
+            if (cmd.starts_with("[[BATCH]]")) {
+                cmd.remove_prefix(9);
+
+                std::string reply;
+                for (const auto& part : std::views::split(cmd, ';')) {
+                    const auto PART = std::string_view{part};
+                    if (PART.empty())
+                        continue;
+
+                    if (!reply.empty())
+                        reply += "\n\n\n";
+
+                    reply += PART.starts_with(CLOSE) ? closeWindow(PART.substr(CLOSE.size())) : "unknown request";
+                }
+                return reply;
+            }
+
+            if (cmd.starts_with(CLOSE))
+                return closeWindow(cmd.substr(CLOSE.size()));
+
+            return "unknown request";
+        };
+
+        std::string buffer;
+        buffer.resize(65536);
+
+        while (true) {
+            pollfd fds[] = {{.fd = REQUESTS, .events = POLLIN, .revents = 0}, {.fd = EVENTS, .events = POLLIN, .revents = 0}};
+            if (poll(fds, 2, -1) <= 0)
+                continue;
+
+            if (fds[1].revents & POLLIN) {
+                if (const int FD = accept4(EVENTS, nullptr, nullptr, SOCK_CLOEXEC); FD >= 0)
+                    subscribers.emplace_back(FD);
+            }
+
+            if (!(fds[0].revents & POLLIN))
+                continue;
+
+            const int FD = accept4(REQUESTS, nullptr, nullptr, SOCK_CLOEXEC);
+            if (FD < 0)
+                continue;
+
+            // requests are written in one go before the reply is read
+            const auto LEN = read(FD, buffer.data(), buffer.size());
+            if (LEN > 0) {
+                const auto REPLY = handle(std::string_view{buffer.data(), sc<size_t>(LEN)});
+                for (size_t written = 0; written < REPLY.size();) {
+                    const auto W = write(FD, REPLY.data() + written, REPLY.size() - written);
+                    if (W <= 0)
+                        break;
+                    written += W;
+                }
+            }
+
+            close(FD);
+        }
+    }
+
+    double cpuMs() {
+        timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+    }
+};
+
+int main(int argc, const char** argv) {
+    Hyprutils::CLI::CArgumentParser parser({argv, sc<size_t>(argc)});
+
+    ASSERT(parser.registerIntOption("windows", "w", "Windows to serve (default 100)"));
+    ASSERT(parser.registerIntOption("layers", "l", "Layer surfaces to serve (default 4)"));
+    ASSERT(parser.registerIntOption("children", "c", "Windowless children of hyprland (default 20)"));
+    ASSERT(parser.registerIntOption("exit-delay", "d", "Milliseconds each app takes to exit once asked (default 50)"));
+    ASSERT(parser.registerIntOption("stubborn", "s", "How many of the children ignore the first SIGTERM (default 0)"));
+    ASSERT(parser.registerIntOption("kill-after", "k", "Escalate like hyprshutdown --timeout (default: never)"));
+    ASSERT(parser.registerIntOption("wave-size", "", "Like hyprshutdown --wave-size (default: all at once)"));
+    ASSERT(parser.registerIntOption("timeout", "", "Give up after this many seconds (default 30)"));
+    ASSERT(parser.registerBoolOption("verbose", "", "Enable more logging"));
+    ASSERT(parser.registerBoolOption("help", "h", "Show the help menu"));
+
+    if (const auto ret = parser.parse(); !ret) {
+        g_logger->log(LOG_ERR, "Failed parsing arguments: {}", ret.error());
+        return 1;
+    }
+
+    if (parser.getBool("help").value_or(false)) {
+        std::println("{}", parser.getDescription("hyprshutdown end to end shutdown benchmark"));
+        return 0;
+    }
+
+    g_logger->setLogLevel(parser.getBool("verbose").value_or(false) ? LOG_TRACE : LOG_ERR);
+
+    SConfig config;
+    config.windows   = parser.getInt("windows").value_or(config.windows);
+    config.layers    = parser.getInt("layers").value_or(config.layers);
+    config.children  = parser.getInt("children").value_or(config.children);
+    config.exitDelay = parser.getInt("exit-delay").value_or(config.exitDelay);
+    config.stubborn  = parser.getInt("stubborn").value_or(config.stubborn);
+    config.timeout   = parser.getInt("timeout").value_or(config.timeout);
+
+    // a private runtime dir with one instance in it, which is all hyprshutdown looks at
+    char tmpl[] = "/tmp/hyprshutdown-bench.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        g_logger->log(LOG_ERR, "Couldn't create a runtime dir");
+        return 1;
+    }
+
+    const std::filesystem::path RUNTIME = tmpl;
+    const auto                  HIS     = std::format("bench_{}_0", time(nullptr));
+    const auto                  DIR     = RUNTIME / "hypr" / HIS;
+    std::filesystem::create_directories(DIR);
+
+    setenv("XDG_RUNTIME_DIR", RUNTIME.c_str(), 1);
+    setenv("HYPRLAND_INSTANCE_SIGNATURE", HIS.c_str(), 1);
+    // and no exit history of past runs
+    setenv("XDG_CACHE_HOME", (RUNTIME / "cache").c_str(), 1);
+
+    int ready[2];
+    if (pipe(ready) < 0)
+        return 1;
+
+    const auto HLPID = fork();
+    if (HLPID < 0)
+        return 1;
+
+    if (HLPID == 0) {
+        close(ready[0]);
+        fakeHyprland(DIR, config, ready[1]);
+    }
+
+    close(ready[1]);
+
+    char c = 0;
+    if (read(ready[0], &c, 1) != 1) {
+        g_logger->log(LOG_ERR, "The fake hyprland didn't start");
+        return 1;
+    }
+    close(ready[0]);
+
+    std::ofstream(DIR / "hyprland.lock") << std::format("{}\nwayland-bench\n", HLPID);
+
+    const auto STARTED  = std::chrono::steady_clock::now();
+    const auto CPUSTART = cpuMs();
+
+    const auto STATE = State::state();
+    const auto LOOP  = makeShared<State::CPollLoop>();
+
+    if (const auto KILLAFTER = parser.getInt("kill-after"); KILLAFTER && *KILLAFTER > 0)
+        STATE->m_escalation = {.term = *KILLAFTER / 2.F, .kill = sc<float>(*KILLAFTER)};
+
+    STATE->m_waveSize = std::max(0, parser.getInt("wave-size").value_or(0));
+
+    if (!STATE->init()) {
+        g_logger->log(LOG_ERR, "Failed to init state");
+        kill(-HLPID, SIGKILL);
+        return 1;
+    }
+
+    const auto APPS = STATE->apps().size();
+
+    STATE->setEventLoop(LOOP);
+
+    // ticks at whatever pace the state asks for, like the UI does
+    uint64_t   ticks    = 0;
+    double     tickCpu  = 0;
+    auto       nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(150);
+    const auto DEADLINE = STARTED + std::chrono::seconds(config.timeout);
+
+    while (!STATE->apps().empty() && std::chrono::steady_clock::now() < DEADLINE) {
+        const auto NOW = std::chrono::steady_clock::now();
+
+        if (NOW < nextTick) {
+            LOOP->dispatch(std::chrono::ceil<std::chrono::milliseconds>(std::min(nextTick, DEADLINE) - NOW));
+            continue;
+        }
+
+        ticks++;
+
+        const auto TICKSTART = cpuMs();
+        nextTick             = NOW + STATE->tick();
+        tickCpu += cpuMs() - TICKSTART;
+    }
+
+    const double ELAPSED = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - STARTED).count();
+    const double CPU     = cpuMs() - CPUSTART;
+    const bool   EMPTIED = STATE->apps().empty();
+
+    if (!EMPTIED)
+        STATE->killAllApps();
+
+    STATE->setEventLoop(nullptr);
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    const auto IPC = HyprlandIPC::stats();
+
+    std::println("apps:          {} ({} windows, {} layers, {} children, {} stubborn)", APPS, config.windows, config.layers, config.children, config.stubborn);
+    std::println("time to empty: {}", EMPTIED ? std::format("{:.1f}ms", ELAPSED) : std::format("timed out, {} apps left", STATE->apps().size()));
+    std::println("ipc:           {} calls, {} failed, {:.3f}ms avg, {:.3f}ms max", IPC.calls, IPC.failures, IPC.calls ? IPC.totalLatency / IPC.calls : 0.0,
+                 IPC.maxLatency);
+    std::println("ticks:         {}, {:.3f}ms cpu per tick", ticks, ticks ? tickCpu / ticks : 0.0);
+    std::println("cpu:           {:.1f}ms total", CPU);
+    std::println("peak rss:      {}kB", usage.ru_maxrss);
+
+    kill(-HLPID, SIGKILL);
+    waitpid(HLPID, nullptr, 0);
+
+    std::error_code ec;
+    std::filesystem::remove_all(RUNTIME, ec);
+
+    return EMPTIED ? 0 : 1;
+}
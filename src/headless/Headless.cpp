@@ -0,0 +1,139 @@
+#include "Headless.hpp"
+#include "../helpers/Logger.hpp"
+#include "../state/AppState.hpp"
+#include "../state/HyprlandIPC.hpp"
+#include "../state/StatusServer.hpp"
+
+#include <cstdio>
+#include <print>
+
+#include <hyprutils/os/Process.hpp>
+
+using namespace Hyprutils::OS;
+
+void CHeadless::printProgress() {
+    const auto& APPS = State::state()->apps();
+
+    if (m_lastCount == APPS.size())
+        return;
+
+    m_lastCount = APPS.size();
+
+    if (APPS.empty()) {
+        std::println("All apps exited");
+        std::fflush(stdout);
+        return;
+    }
+
+    std::string names;
+    for (const auto& app : APPS) {
+        if (!names.empty())
+            names += ", ";
+        names += app->m_class;
+    }
+
+    std::println("Waiting for {} app(s): {}", APPS.size(), names);
+
+    // we're usually piped into a log, which would buffer this until exit
+    std::fflush(stdout);
+}
+
+void CHeadless::exit(bool closeHl) {
+    if (m_exiting)
+        return;
+
+    // the loop in run() winds down on its next iteration
+    m_exiting = true;
+    m_closeHl = closeHl;
+
+    if (g_statusServer)
+        g_statusServer->finish(closeHl);
+}
+
+bool CHeadless::cancelled() const {
+    return !m_closeHl;
+}
+
+void CHeadless::onDiscovered(bool ok) {
+    if (!ok) {
+        g_logger->log(LOG_ERR, "Failed to init state");
+        m_failed = true;
+        exit(false);
+    }
+}
+
+void CHeadless::onStateChanged() {
+    if (m_exiting)
+        return;
+
+    if (State::state()->discovering())
+        return;
+
+    printProgress();
+
+    if (State::state()->apps().empty())
+        exit(true);
+}
+
+bool CHeadless::run() {
+    m_loop = makeShared<State::CPollLoop>();
+
+    m_listeners.stateChanged = State::state()->m_events.changed.listen([this] { onStateChanged(); });
+    m_listeners.discovered   = State::state()->m_events.discovered.listen([this](bool ok) { onDiscovered(ok); });
+    m_listeners.killed       = State::state()->m_events.killed.listen([this] { exit(true); });
+    State::state()->setEventLoop(m_loop);
+
+    if (g_statusServer) {
+        m_listeners.statusCancel    = g_statusServer->m_events.cancel.listen([this] { exit(false); });
+        m_listeners.statusForceQuit = g_statusServer->m_events.forceQuit.listen([] { State::state()->killAllApps(); });
+        g_statusServer->setEventLoop(m_loop);
+    }
+
+    std::println("Looking for running apps...");
+    std::fflush(stdout);
+
+    State::state()->initAsync();
+
+    // same cadence as the UI timer: the state says when it next needs a tick
+    auto nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(150);
+
+    while (!m_exiting) {
+        const auto NOW = std::chrono::steady_clock::now();
+
+        if (NOW < nextTick) {
+            m_loop->dispatch(std::chrono::ceil<std::chrono::milliseconds>(nextTick - NOW));
+            continue;
+        }
+
+        if (State::state()->apps().empty() && !State::state()->discovering()) {
+            exit(true);
+            break;
+        }
+
+        State::state()->telemetry().onTick();
+
+        nextTick = NOW + State::state()->tick();
+    }
+
+    if (g_statusServer)
+        g_statusServer->setEventLoop(nullptr);
+
+    State::state()->setEventLoop(nullptr);
+    m_listeners.stateChanged.reset();
+    m_listeners.discovered.reset();
+    m_listeners.killed.reset();
+    m_listeners.statusCancel.reset();
+    m_listeners.statusForceQuit.reset();
+    m_loop.reset();
+
+    if (m_closeHl && !m_noExit && !State::state()->m_dryRun) {
+        //NOLINTNEXTLINE
+        HyprlandIPC::getFromSocket("/dispatch exit");
+        if (m_postExitCmd) {
+            CProcess proc("/bin/sh", {"-c", m_postExitCmd.value()});
+            proc.runAsync();
+        }
+    }
+
+    return !m_failed;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include <hyprutils/signal/Listener.hpp>
+
+#include "../helpers/Memory.hpp"
+#include "../state/PollLoop.hpp"
+
+// Drives the state without the UI: no backend, no windows, just a poll loop and progress on stdout.
+// Mirrors what CUI does around the state, for --no-ui.
+class CHeadless {
+  public:
+    CHeadless()  = default;
+    ~CHeadless() = default;
+
+    CHeadless(const CHeadless&) = delete;
+    CHeadless(CHeadless&)       = delete;
+    CHeadless(CHeadless&&)      = delete;
+
+    bool                       run();
+
+    // stopped without closing hyprland
+    bool                       cancelled() const;
+
+    bool                       m_noExit = false;
+    std::optional<std::string> m_postExitCmd;
+
+  private:
+    void                  onStateChanged();
+    void                  onDiscovered(bool ok);
+    void                  printProgress();
+
+    void                  exit(bool closeHl = false);
+
+    SP<State::CPollLoop>  m_loop;
+
+    bool                  m_exiting = false;
+    bool                  m_closeHl = false;
+    bool                  m_failed  = false;
+
+    // last count printed, so unrelated changes don't spam
+    std::optional<size_t> m_lastCount;
+
+    struct {
+        Hyprutils::Signal::CHyprSignalListener stateChanged;
+        Hyprutils::Signal::CHyprSignalListener discovered;
+        Hyprutils::Signal::CHyprSignalListener killed;
+        Hyprutils::Signal::CHyprSignalListener statusCancel;
+        Hyprutils::Signal::CHyprSignalListener statusForceQuit;
+    } m_listeners;
+};
@@ -0,0 +1,188 @@
+#include "Cgroup.hpp"
+#include "OS.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <charconv>
+#include <cctype>
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <hyprutils/memory/Casts.hpp>
+
+using namespace Hyprutils::Memory;
+
+static const std::optional<std::string>& mountPoint() {
+    static const auto MOUNT = []() -> std::optional<std::string> {
+        std::ifstream ifs("/proc/self/mounts");
+        if (!ifs.good())
+            return std::nullopt;
+
+        // device mountpoint fstype options ...
+        std::string device, mount, fstype, line;
+        while (ifs >> device >> mount >> fstype) {
+            if (fstype == "cgroup2")
+                return mount;
+
+            std::getline(ifs, line);
+        }
+
+        return std::nullopt;
+    }();
+
+    return MOUNT;
+}
+
+std::optional<std::string> Cgroup::cgroupOf(int64_t pid) {
+    const auto& MOUNT = mountPoint();
+    if (!MOUNT)
+        return std::nullopt;
+
+    std::ifstream ifs(std::format("/proc/{}/cgroup", pid));
+    if (!ifs.good())
+        return std::nullopt;
+
+    // the unified hierarchy is the one with id 0 and no controllers
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (!line.starts_with("0::"))
+            continue;
+
+        return *MOUNT + line.substr(3);
+    }
+
+    return std::nullopt;
+}
+
+std::vector<int64_t> Cgroup::procs(const std::string& cgroup, bool recursive) {
+    std::vector<int64_t> result;
+
+    const auto           readProcs = [&result](const std::filesystem::path& dir) {
+        std::ifstream ifs(dir / "cgroup.procs");
+        std::string   line;
+        while (std::getline(ifs, line)) {
+            int64_t pid          = 0;
+            const auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), pid);
+            if (ec == std::errc())
+                result.emplace_back(pid);
+        }
+    };
+
+    readProcs(cgroup);
+
+    if (!recursive)
+        return result;
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(cgroup, std::filesystem::directory_options::skip_permission_denied, ec)) {
+        if (entry.is_directory(ec))
+            readProcs(entry.path());
+    }
+
+    return result;
+}
+
+bool Cgroup::populated(const std::string& cgroup) {
+    std::ifstream ifs(cgroup + "/cgroup.events");
+
+    // gone means empty
+    if (!ifs.good())
+        return false;
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.starts_with("populated "))
+            return line.substr(10) != "0";
+    }
+
+    return false;
+}
+
+bool Cgroup::kill(const std::string& cgroup) {
+    const int FD = open((cgroup + "/cgroup.kill").c_str(), O_WRONLY | O_CLOEXEC);
+    if (FD < 0)
+        return false;
+
+    const bool OK = write(FD, "1", 1) == 1;
+    close(FD);
+
+    return OK;
+}
+
+void Cgroup::signal(const std::string& cgroup, int sig) {
+    for (const auto& pid : procs(cgroup)) {
+        // pin the process first, then make sure it's still the one we listed: a pid that exited and got
+        // reused in between has left the cgroup by then
+        const auto PIDFD = OS::pidfdOpen(pid);
+        if (!PIDFD.isValid()) {
+            // no pidfds (pre 5.3 or a BSD): the reuse window is as small as we can make it
+            ::kill(pid, sig);
+            continue;
+        }
+
+        const auto CG = cgroupOf(pid);
+        if (!CG || (*CG != cgroup && !CG->starts_with(cgroup + "/")))
+            continue;
+
+        OS::pidfdSendSignal(PIDFD.get(), sig);
+    }
+}
+
+std::vector<std::string> Cgroup::appScopes(const std::string& sessionCgroup, const std::string& desktop) {
+    std::vector<std::string> result;
+
+    // the user manager, e.g. /sys/fs/cgroup/user.slice/user-1000.slice/user@1000.service
+    const auto USER = sessionCgroup.find("/user@");
+    if (USER == std::string::npos)
+        return result;
+
+    const auto USEREND = sessionCgroup.find('/', USER + 1);
+    const auto BASE    = std::filesystem::path{sessionCgroup.substr(0, USEREND)} / "app.slice";
+
+    const auto PREFIX = std::format("app-{}-", desktop);
+
+    std::error_code ec;
+    for (auto it = std::filesystem::recursive_directory_iterator(BASE, std::filesystem::directory_options::skip_permission_denied, ec);
+         it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec)
+            break;
+
+        if (!it->is_directory(ec))
+            continue;
+
+        const auto NAME = it->path().filename().string();
+
+        if (!NAME.starts_with(PREFIX) || !(NAME.ends_with(".scope") || NAME.ends_with(".service")))
+            continue;
+
+        result.emplace_back(it->path().string());
+
+        // a unit's sub-cgroups belong to it
+        it.disable_recursion_pending();
+    }
+
+    return result;
+}
+
+std::string Cgroup::appNameForScope(const std::string& scope, const std::string& desktop) {
+    std::string name = std::filesystem::path{scope}.filename().string();
+
+    if (const auto PREFIX = std::format("app-{}-", desktop); name.starts_with(PREFIX))
+        name = name.substr(PREFIX.size());
+
+    name = name.substr(0, name.find_last_of('.'));
+
+    // services are name@random, scopes are name-random
+    if (const auto AT = name.find('@'); AT != std::string::npos)
+        return name.substr(0, AT);
+
+    if (const auto DASH = name.find_last_of('-'); DASH != std::string::npos && DASH + 1 < name.size() &&
+        std::ranges::all_of(name.substr(DASH + 1), [](char c) { return std::isxdigit(sc<unsigned char>(c)); }))
+        return name.substr(0, DASH);
+
+    return name;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// cgroup v2 helpers. All paths are absolute filesystem paths of cgroup directories.
+namespace Cgroup {
+    // nullopt if there is no unified (v2) hierarchy
+    std::optional<std::string> cgroupOf(int64_t pid);
+
+    std::vector<int64_t>       procs(const std::string& cgroup, bool recursive = true);
+    bool                       populated(const std::string& cgroup);
+
+    // kills everything in the cgroup and below with one write. Needs linux 5.14+
+    bool                       kill(const std::string& cgroup);
+    // sig to everything in the cgroup and below, through pidfds so a recycled pid can't be hit
+    void                       signal(const std::string& cgroup, int sig);
+
+    // app units created for the given desktop below the user manager sessionCgroup lives in,
+    // following the systemd app unit naming uwsm uses (app-<desktop>-<name>[@-]<random>.{scope,service})
+    std::vector<std::string>   appScopes(const std::string& sessionCgroup, const std::string& desktop);
+
+    // "app-Hyprland-kitty@a1b2.service" -> "kitty"
+    std::string                appNameForScope(const std::string& scope, const std::string& desktop);
+};
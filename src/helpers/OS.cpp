@@ -3,6 +3,24 @@
 #include <filesystem>
 #include <fstream>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <hyprutils/utils/ScopeGuard.hpp>
+
 #include <hyprutils/string/String.hpp>
 #include <hyprutils/memory/Casts.hpp>
 
@@ -22,11 +40,23 @@
 #define KINFO_PROC struct kinfo_proc
 #endif
 #if defined(__DragonFly__)
+#define KP_PID(kp)  kp.kp_pid
 #define KP_PPID(kp) kp.kp_ppid
+#define KP_COMM(kp) kp.kp_comm
 #elif defined(__FreeBSD__)
+#define KP_PID(kp)  kp.ki_pid
 #define KP_PPID(kp) kp.ki_ppid
+#define KP_COMM(kp) kp.ki_comm
 #else
+#define KP_PID(kp)  kp.p_pid
 #define KP_PPID(kp) kp.p_ppid
+#define KP_COMM(kp) kp.p_comm
+#endif
+// every process, without threads
+#if defined(__FreeBSD__)
+#define KP_WHICH_ALL KERN_PROC_PROC
+#else
+#define KP_WHICH_ALL KERN_PROC_ALL
 #endif
 #endif
 
@@ -43,88 +73,209 @@ static std::optional<std::string> linuxExtractFromStatus(std::ifstream& ifs, con
     return std::nullopt;
 }
 
-std::string OS::appNameForPid(int64_t pid) {
+// /proc/<pid>/stat is "pid (comm) state ppid ...". comm can contain anything, including spaces and parens.
+static bool linuxParseStat(const std::string_view& stat, OS::SProcess& proc) {
+    const auto OPEN  = stat.find('(');
+    const auto CLOSE = stat.rfind(')');
+
+    if (OPEN == std::string_view::npos || CLOSE == std::string_view::npos || CLOSE < OPEN)
+        return false;
+
+    // skip ") S "
+    const auto REST = stat.substr(CLOSE + 1);
+    if (REST.size() < 4)
+        return false;
+
+    int64_t ppid         = 0;
+    const auto [ptr, ec] = std::from_chars(REST.data() + 3, REST.data() + REST.size(), ppid);
+    if (ec != std::errc())
+        return false;
+
+    proc.ppid = ppid;
+    proc.name = stat.substr(OPEN + 1, CLOSE - OPEN - 1);
+
+    return true;
+}
+
 #if defined(KERN_PROC_PID)
-    int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PID, Hyprutils::Memory::sc<int>(pid)};
+// NetBSD and OpenBSD want the element size and count in the mib, the others take what they're given
+static std::vector<int> bsdMib(int which, int arg, size_t count) {
+#if defined(__NetBSD__) || defined(__OpenBSD__)
+    return {CTL_KERN, KERN_PROC, which, arg, Hyprutils::Memory::sc<int>(sizeof(KINFO_PROC)), Hyprutils::Memory::sc<int>(count)};
+#else
+    return {CTL_KERN, KERN_PROC, which, arg};
+#endif
+}
+
+// the whole process table in one sysctl
+static std::vector<KINFO_PROC> bsdProcTable() {
+    std::vector<KINFO_PROC> procs;
+
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        size_t len = 0;
+        auto   mib = bsdMib(KP_WHICH_ALL, 0, 0);
+
+        if (sysctl(mib.data(), Hyprutils::Memory::sc<u_int>(mib.size()), nullptr, &len, nullptr, 0) == -1)
+            return {};
+
+        // room for whatever gets spawned between the two calls
+        procs.resize(len / sizeof(KINFO_PROC) + 16);
+        len = procs.size() * sizeof(KINFO_PROC);
+        mib = bsdMib(KP_WHICH_ALL, 0, procs.size());
+
+        if (sysctl(mib.data(), Hyprutils::Memory::sc<u_int>(mib.size()), procs.data(), &len, nullptr, 0) == 0) {
+            procs.resize(len / sizeof(KINFO_PROC));
+            return procs;
+        }
+
+        if (errno != ENOMEM)
+            return {};
+    }
+
+    return {};
+}
+
+static std::optional<KINFO_PROC> bsdProc(int64_t pid) {
     KINFO_PROC kp;
-    size_t len = sizeof(kp);
+    size_t     len = sizeof(kp);
+    auto       mib = bsdMib(KERN_PROC_PID, Hyprutils::Memory::sc<int>(pid), 1);
 
-    if (sysctl(mib, 4, &kp, &len, nullptr, 0) == -1)
-        return "";
-    if (len == 0)
-        return "";
+    if (sysctl(mib.data(), Hyprutils::Memory::sc<u_int>(mib.size()), &kp, &len, nullptr, 0) == -1 || len == 0)
+        return std::nullopt;
 
-#if defined(__FreeBSD__) || defined(__DragonFly__)
-    return kp.ki_comm;
-#elif defined(__NetBSD__) || defined(__OpenBSD__)
-    return kp.p_comm;
+    return kp;
+}
 #endif
+
+OS::CProcessSnapshot::CProcessSnapshot() {
+#if defined(KERN_PROC_PID)
+    const auto PROCS = bsdProcTable();
+
+    m_processes.reserve(PROCS.size());
+    for (const auto& kp : PROCS) {
+        m_processes.emplace_back(SProcess{.pid = KP_PID(kp), .ppid = KP_PPID(kp), .name = KP_COMM(kp)});
+    }
 #else
-    std::string   dir = "/proc/" + std::to_string(pid) + "/status";
-    std::ifstream ifs(dir);
-    if (!ifs.good())
-        return "";
+    DIR* dir = opendir("/proc");
+    if (!dir)
+        return;
 
-    auto data = linuxExtractFromStatus(ifs, "Name");
+    auto        dirGuard = Hyprutils::Utils::CScopeGuard([dir] { closedir(dir); });
 
-    return data.value_or("");
+    const int   DIRFD = dirfd(dir);
+
+    // the stat line is a few hundred bytes, we only need what's before ppid anyways
+    char        buffer[1024];
+    std::string statPath;
+
+    while (const auto* ent = readdir(dir)) {
+        const auto NAMELEN = strlen(ent->d_name);
+        int64_t    pid     = 0;
+
+        const auto [ptr, ec] = std::from_chars(ent->d_name, ent->d_name + NAMELEN, pid);
+        if (ec != std::errc() || ptr != ent->d_name + NAMELEN)
+            continue;
+
+        statPath.assign(ent->d_name, NAMELEN).append("/stat");
+
+        const int FD = openat(DIRFD, statPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (FD < 0)
+            continue; // exited while we were looking
+
+        const auto LEN = read(FD, buffer, sizeof(buffer));
+        close(FD);
+
+        if (LEN <= 0)
+            continue;
+
+        SProcess proc{.pid = pid};
+        if (!linuxParseStat(std::string_view{buffer, Hyprutils::Memory::sc<size_t>(LEN)}, proc))
+            continue;
+
+        m_processes.emplace_back(std::move(proc));
+    }
 #endif
-}
 
-std::vector<int64_t> OS::getAllPids() {
-    std::vector<int64_t> pids;
+    std::ranges::sort(m_processes, {}, &SProcess::pid);
 
-#if defined(KERN_PROC_PID)
-    int                     mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PROC, 0};
-    size_t                  len    = 0;
-    std::vector<kinfo_proc> procs;
+    buildChildIndex();
+}
 
-    if (sysctl(mib, 4, nullptr, &len, nullptr, 0) == -1)
-        return {};
+void OS::CProcessSnapshot::buildChildIndex() {
+    std::vector<size_t> parentOf(m_processes.size(), SIZE_MAX);
 
-    procs.resize(len / sizeof(kinfo_proc));
+    m_childOffsets.assign(m_processes.size() + 1, 0);
 
-    if (sysctl(mib, 4, procs.data(), &len, nullptr, 0) == -1)
-        return {};
+    for (size_t i = 0; i < m_processes.size(); ++i) {
+        const auto PARENT = find(m_processes[i].ppid);
+        if (!PARENT)
+            continue; // root, or the parent is gone already
 
-    pids.reserve(procs.size());
-    for (const auto& p : procs) {
-        pids.emplace_back(p.ki_pid);
+        parentOf[i] = PARENT - m_processes.data();
+        m_childOffsets[parentOf[i] + 1]++;
     }
-#else
-    std::error_code ec;
 
-    if (std::filesystem::exists("/proc/self", ec) && !ec) {
-        for (const std::filesystem::path& p : std::filesystem::directory_iterator("/proc/", ec)) {
-            if (!std::filesystem::exists(p, ec) || ec)
-                continue;
+    for (size_t i = 1; i < m_childOffsets.size(); ++i) {
+        m_childOffsets[i] += m_childOffsets[i - 1];
+    }
 
-            if (!Hyprutils::String::isNumber(p.stem().string()))
-                continue;
+    m_children.resize(m_childOffsets.back());
 
-            try {
-                pids.emplace_back(std::stoll(p.stem()));
-            } catch (...) { ; }
-        }
+    std::vector<size_t> fill{m_childOffsets.begin(), m_childOffsets.end() - 1};
+    for (size_t i = 0; i < m_processes.size(); ++i) {
+        if (parentOf[i] == SIZE_MAX)
+            continue;
+
+        m_children[fill[parentOf[i]]++] = i;
     }
-#endif
+}
 
-    return pids;
+std::span<const size_t> OS::CProcessSnapshot::childrenOf(int64_t pid) const {
+    const auto PROC = find(pid);
+    if (!PROC)
+        return {};
+
+    const size_t IDX = PROC - m_processes.data();
+
+    return std::span<const size_t>{m_children}.subspan(m_childOffsets[IDX], m_childOffsets[IDX + 1] - m_childOffsets[IDX]);
 }
 
-int64_t OS::ppidOf(int64_t pid) {
+const std::vector<OS::SProcess>& OS::CProcessSnapshot::processes() const {
+    return m_processes;
+}
+
+const OS::SProcess* OS::CProcessSnapshot::find(int64_t pid) const {
+    const auto IT = std::ranges::lower_bound(m_processes, pid, {}, &SProcess::pid);
+
+    if (IT == m_processes.end() || IT->pid != pid)
+        return nullptr;
+
+    return &*IT;
+}
+
+std::string OS::appNameForPid(int64_t pid) {
 #if defined(KERN_PROC_PID)
-    int mib[] = {
-        CTL_KERN,           KERN_PROC, KERN_PROC_PID, (int)pid,
-#if defined(__NetBSD__) || defined(__OpenBSD__)
-        sizeof(KINFO_PROC), 1,
+    const auto KP = bsdProc(pid);
+    if (!KP)
+        return "";
+
+    return KP_COMM((*KP));
+#else
+    std::string   dir = "/proc/" + std::to_string(pid) + "/status";
+    std::ifstream ifs(dir);
+    if (!ifs.good())
+        return "";
+
+    auto data = linuxExtractFromStatus(ifs, "Name");
+
+    return data.value_or("");
 #endif
-    };
-    u_int      miblen = sizeof(mib) / sizeof(mib[0]);
-    KINFO_PROC kp;
-    size_t     sz = sizeof(KINFO_PROC);
-    if (sysctl(mib, miblen, &kp, &sz, nullptr, 0) != -1)
-        return KP_PPID(kp);
+}
+
+int64_t OS::ppidOf(int64_t pid) {
+#if defined(KERN_PROC_PID)
+    if (const auto KP = bsdProc(pid); KP)
+        return KP_PPID((*KP));
 #else
     std::string   dir = "/proc/" + std::to_string(pid) + "/status";
     std::ifstream ifs(dir);
@@ -143,3 +294,42 @@ int64_t OS::ppidOf(int64_t pid) {
 
     return -1;
 }
+
+std::optional<std::vector<int64_t>> OS::childPids(int64_t pid) {
+#if defined(__linux__)
+    // children of the main thread, which is who forks in practically everything we care about
+    std::ifstream ifs(std::format("/proc/{}/task/{}/children", pid, pid));
+    if (!ifs.good())
+        return std::nullopt;
+
+    std::vector<int64_t> result;
+    int64_t              child = 0;
+    while (ifs >> child) {
+        result.emplace_back(child);
+    }
+
+    return result;
+#else
+    return std::nullopt;
+#endif
+}
+
+Hyprutils::OS::CFileDescriptor OS::pidfdOpen(int64_t pid) {
+#if defined(SYS_pidfd_open)
+    if (pid <= 0)
+        return {};
+
+    return Hyprutils::OS::CFileDescriptor{Hyprutils::Memory::sc<int>(syscall(SYS_pidfd_open, Hyprutils::Memory::sc<pid_t>(pid), 0))};
+#else
+    return {};
+#endif
+}
+
+bool OS::pidfdSendSignal(int pidfd, int sig) {
+#if defined(SYS_pidfd_send_signal)
+    return syscall(SYS_pidfd_send_signal, pidfd, sig, nullptr, 0) == 0;
+#else
+    errno = ENOSYS;
+    return false;
+#endif
+}
\ No newline at end of file
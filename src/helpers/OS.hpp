@@ -1,11 +1,54 @@
 #pragma once
 
+#include <optional>
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <span>
+
+#include <hyprutils/os/FileDescriptor.hpp>
 
 namespace OS {
-    std::vector<int64_t> getAllPids();
-    std::string          appNameForPid(int64_t pid);
-    int64_t              ppidOf(int64_t pid);
+    struct SProcess {
+        int64_t     pid  = -1;
+        int64_t     ppid = -1;
+        std::string name;
+    };
+
+    // The process table, read in a single pass. Sorted by pid.
+    class CProcessSnapshot {
+      public:
+        CProcessSnapshot();
+        ~CProcessSnapshot() = default;
+
+        CProcessSnapshot(const CProcessSnapshot&) = delete;
+        CProcessSnapshot(CProcessSnapshot&)       = delete;
+        CProcessSnapshot(CProcessSnapshot&&)      = delete;
+
+        const std::vector<SProcess>& processes() const;
+        const SProcess*              find(int64_t pid) const;
+
+        // indices into processes() of the direct children of pid.
+        // Backed by an index built once, so walking a whole subtree is O(n).
+        std::span<const size_t> childrenOf(int64_t pid) const;
+
+      private:
+        void                  buildChildIndex();
+
+        std::vector<SProcess> m_processes;
+
+        // children of m_processes[i] are m_children[m_childOffsets[i] .. m_childOffsets[i + 1]]
+        std::vector<size_t> m_childOffsets;
+        std::vector<size_t> m_children;
+    };
+
+    std::string appNameForPid(int64_t pid);
+    int64_t     ppidOf(int64_t pid);
+
+    // direct children, without a full scan. nullopt where the kernel can't tell us (BSDs, no CONFIG_PROC_CHILDREN)
+    std::optional<std::vector<int64_t>> childPids(int64_t pid);
+
+    // invalid fd if pidfds aren't supported (old kernels, BSDs)
+    Hyprutils::OS::CFileDescriptor pidfdOpen(int64_t pid);
+    bool                           pidfdSendSignal(int pidfd, int sig);
 };
\ No newline at end of file
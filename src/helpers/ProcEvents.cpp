@@ -0,0 +1,115 @@
+#include "ProcEvents.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <hyprutils/memory/Casts.hpp>
+
+using namespace Hyprutils::Memory;
+
+bool OS::CProcEvents::open() {
+#if defined(__linux__)
+    Hyprutils::OS::CFileDescriptor fd{socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR)};
+    if (!fd.isValid())
+        return false;
+
+    sockaddr_nl address = {0};
+    address.nl_family   = AF_NETLINK;
+    address.nl_groups   = CN_IDX_PROC;
+    address.nl_pid      = 0; // let the kernel pick
+
+    // EPERM without CAP_NET_ADMIN
+    if (bind(fd.get(), rc<sockaddr*>(&address), sizeof(address)) < 0)
+        return false;
+
+    // nlmsghdr, then cn_msg, then the op as its payload
+    alignas(nlmsghdr) char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))] = {0};
+
+    auto*                  header = rc<nlmsghdr*>(request);
+    header->nlmsg_len             = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+    header->nlmsg_type            = NLMSG_DONE;
+    header->nlmsg_pid             = getpid();
+
+    auto* message   = rc<cn_msg*>(NLMSG_DATA(header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len    = sizeof(proc_cn_mcast_op);
+
+    const proc_cn_mcast_op OP = PROC_CN_MCAST_LISTEN;
+    memcpy(message->data, &OP, sizeof(OP));
+
+    if (send(fd.get(), request, header->nlmsg_len, 0) != sc<ssize_t>(header->nlmsg_len))
+        return false;
+
+    m_fd = std::move(fd);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+int OS::CProcEvents::fd() const {
+    return m_fd.get();
+}
+
+bool OS::CProcEvents::dispatch(const std::function<void(const SEvent&)>& fn) {
+#if defined(__linux__)
+    if (!m_fd.isValid())
+        return false;
+
+    alignas(nlmsghdr) char buffer[8192];
+
+    while (true) {
+        const auto LEN = recv(m_fd.get(), buffer, sizeof(buffer), 0);
+
+        if (LEN < 0 && errno == EINTR)
+            continue;
+
+        if (LEN < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        // ENOBUFS: we fell behind and the kernel dropped some. Reported like a dead socket, what we know can't be trusted anymore
+        if (LEN <= 0)
+            return false;
+
+        auto remaining = sc<unsigned int>(LEN);
+        for (auto* header = rc<nlmsghdr*>(buffer); NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_NOOP)
+                continue;
+
+            const auto* MESSAGE = rc<const cn_msg*>(NLMSG_DATA(header));
+            if (MESSAGE->id.idx != CN_IDX_PROC || MESSAGE->id.val != CN_VAL_PROC)
+                continue;
+
+            const auto* EVENT = rc<const proc_event*>(MESSAGE->data);
+
+            switch (EVENT->what) {
+                case proc_event::PROC_EVENT_FORK:
+                    // a new thread has the tgid of its creator
+                    if (EVENT->event_data.fork.child_pid != EVENT->event_data.fork.child_tgid)
+                        break;
+                    fn(SEvent{.type = PROC_EVENT_TYPE_FORK, .pid = EVENT->event_data.fork.child_tgid, .ppid = EVENT->event_data.fork.parent_tgid});
+                    break;
+                case proc_event::PROC_EVENT_EXEC: fn(SEvent{.type = PROC_EVENT_TYPE_EXEC, .pid = EVENT->event_data.exec.process_tgid}); break;
+                case proc_event::PROC_EVENT_EXIT:
+                    if (EVENT->event_data.exit.process_pid != EVENT->event_data.exit.process_tgid)
+                        break;
+                    fn(SEvent{.type = PROC_EVENT_TYPE_EXIT, .pid = EVENT->event_data.exit.process_tgid});
+                    break;
+                default: break;
+            }
+        }
+    }
+#else
+    return false;
+#endif
+}
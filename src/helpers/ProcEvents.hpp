@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include <hyprutils/os/FileDescriptor.hpp>
+
+namespace OS {
+    // Process lifecycle events from the kernel (the netlink proc connector).
+    // Linux only, and needs CAP_NET_ADMIN: open() failing is the usual case for a user session.
+    class CProcEvents {
+      public:
+        CProcEvents()  = default;
+        ~CProcEvents() = default;
+
+        CProcEvents(const CProcEvents&) = delete;
+        CProcEvents(CProcEvents&)       = delete;
+        CProcEvents(CProcEvents&&)      = delete;
+
+        enum eEventType : uint8_t {
+            PROC_EVENT_TYPE_FORK = 0, // pid is the new process, ppid its parent
+            PROC_EVENT_TYPE_EXEC,
+            PROC_EVENT_TYPE_EXIT,
+        };
+
+        struct SEvent {
+            eEventType type;
+            int64_t    pid  = -1;
+            int64_t    ppid = -1;
+        };
+
+        bool open();
+        int  fd() const;
+
+        // reads everything available. Threads are filtered out, only processes come through.
+        // Returns false if the socket died or the kernel dropped events, either way it has to go and the tree be rescanned.
+        bool dispatch(const std::function<void(const SEvent&)>& fn);
+
+      private:
+        Hyprutils::OS::CFileDescriptor m_fd;
+    };
+};
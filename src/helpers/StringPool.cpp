@@ -0,0 +1,17 @@
+#include "StringPool.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+std::string_view StringPool::intern(std::string_view str) {
+    // nodes never move, views into them stay valid
+    static std::unordered_set<std::string, SHash, std::equal_to<>> pool;
+    static std::mutex                                              poolMutex;
+
+    std::lock_guard<std::mutex>                                    lg(poolMutex);
+
+    if (const auto IT = pool.find(str); IT != pool.end())
+        return *IT;
+
+    return *pool.emplace(str).first;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Interned strings live as long as the process, so views of them can be kept and compared freely.
+// Apps of one class (terminals, browser popups, Xwayland windows) all share a single copy.
+namespace StringPool {
+    std::string_view intern(std::string_view str);
+
+    // lets std::string keyed maps be looked up with a string_view, without allocating
+    struct SHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view str) const {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+};
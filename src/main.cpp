@@ -1,6 +1,10 @@
 #include "helpers/Asserts.hpp"
 #include "ui/UI.hpp"
+#include "headless/Headless.hpp"
 #include "state/AppState.hpp"
+#include "state/HyprlandIPC.hpp"
+#include "state/StatusServer.hpp"
+#include "state/DaemonTrigger.hpp"
 
 #include <csignal>
 #include <unistd.h>
@@ -9,10 +13,33 @@
 #include <hyprutils/cli/ArgumentParser.hpp>
 #include <hyprutils/os/Process.hpp>
 
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <print>
+#include <ranges>
 
 using namespace Hyprutils::OS;
 
+// per command ipc latencies, for --verbose
+static void logIPCStats() {
+    for (const auto& [cmd, stats] : HyprlandIPC::client().commands()) {
+        std::string histogram;
+        for (size_t i = 0; i < stats.histogram.size(); ++i) {
+            if (!stats.histogram[i])
+                continue;
+
+            if (i < HyprlandIPC::LATENCY_BUCKETS.size())
+                histogram += std::format(" <={}ms:{}", HyprlandIPC::LATENCY_BUCKETS[i], stats.histogram[i]);
+            else
+                histogram += std::format(" >{}ms:{}", HyprlandIPC::LATENCY_BUCKETS.back(), stats.histogram[i]);
+        }
+
+        g_logger->log(LOG_TRACE, "ipc {}: {} calls, {} failed, {:.3f}ms avg, {:.3f}ms max,{}", cmd, stats.calls, stats.failures, stats.totalLatency / stats.calls,
+                      stats.maxLatency, histogram);
+    }
+}
+
 // fork off of the parent process, so we don't get killed
 static void forkoff() {
     pid_t pid = fork();
@@ -35,6 +62,36 @@ static void forkoff() {
     umask(0);
 }
 
+// options a daemon wouldn't honor if we handed the run to it
+static constexpr std::array LOCAL_BOOL_OPTIONS   = {"dry-run", "no-exit", "cgroups", "status-socket"};
+static constexpr std::array LOCAL_INT_OPTIONS    = {"timeout", "wave-size", "update-interval", "status-fd", "vt"};
+static constexpr std::array LOCAL_STRING_OPTIONS = {"top-label", "post-cmd", "class-timeout", "report"};
+
+// closewindow first, SIGTERM halfway through, SIGKILL at the timeout
+static State::CAppState::SEscalation escalationWithTimeout(int timeout) {
+    return {.term = timeout / 2.F, .kill = sc<float>(timeout)};
+}
+
+// "class=seconds,class=seconds"
+static bool parseClassTimeouts(std::string_view rules) {
+    for (const auto& rule : std::views::split(rules, ',')) {
+        const auto RULE = std::string_view{rule};
+        const auto EQ   = RULE.find_last_of('=');
+        if (EQ == std::string_view::npos || EQ == 0)
+            return false;
+
+        const auto VALUE     = RULE.substr(EQ + 1);
+        int        timeout   = 0;
+        const auto [ptr, ec] = std::from_chars(VALUE.data(), VALUE.data() + VALUE.size(), timeout);
+        if (ec != std::errc() || ptr != VALUE.data() + VALUE.size() || timeout <= 0)
+            return false;
+
+        State::state()->m_classEscalation[std::string{RULE.substr(0, EQ)}] = escalationWithTimeout(timeout);
+    }
+
+    return true;
+}
+
 int main(int argc, const char** argv, const char** envp) {
     Hyprutils::CLI::CArgumentParser parser({argv, sc<size_t>(argc)});
 
@@ -43,7 +100,18 @@ int main(int argc, const char** argv, const char** envp) {
     ASSERT(parser.registerStringOption("top-label", "t", "Set the text appearing on top (set to \"Shutting down...\" by default)"));
     ASSERT(parser.registerStringOption("post-cmd", "p", "Set a command ran after all apps and Hyprland shut down"));
     ASSERT(parser.registerBoolOption("verbose", "", "Enable more logging"));
+    ASSERT(parser.registerIntOption("update-interval", "", "Apply app list changes to the overlay at most every N ms (default: 16, 0 for every change)"));
+    ASSERT(parser.registerBoolOption("status-socket", "", "Stream progress as JSON lines on $XDG_RUNTIME_DIR/hypr/$HIS/hyprshutdown.sock, and take actions from it"));
+    ASSERT(parser.registerIntOption("status-fd", "", "Stream progress as JSON lines to fd N"));
+    ASSERT(parser.registerBoolOption("daemon", "", "Stay resident with the overlay ready, and show it once another hyprshutdown arms us (e.g. from exec-once)"));
+    ASSERT(parser.registerBoolOption("no-daemon", "", "Run on our own even if a --daemon is waiting"));
+    ASSERT(parser.registerBoolOption("no-ui", "", "Do not show the overlay, print progress to stdout instead"));
     ASSERT(parser.registerBoolOption("no-fork", "", "Do not fork/daemonize (run in foreground)"));
+    ASSERT(parser.registerBoolOption("cgroups", "", "Find apps through cgroup v2 (Hyprland's cgroup and uwsm app scopes) instead of the process tree"));
+    ASSERT(parser.registerIntOption("timeout", "", "Kill apps still running this many seconds after they were asked to quit (SIGTERM at half of it)"));
+    ASSERT(parser.registerStringOption("class-timeout", "", "Per class timeouts, overriding --timeout, e.g. \"steam=5,firefox=30\""));
+    ASSERT(parser.registerIntOption("wave-size", "", "Close at most N apps at once, windows first, then layers, then background processes (default: all at once)"));
+    ASSERT(parser.registerStringOption("report", "", "Write a JSON report of how long each app took to exit to the given path"));
     ASSERT(parser.registerIntOption("vt", "", "Switch to VT N after Hyprland exits (fixes NVIDIA+SDDM black screen)"));
     ASSERT(parser.registerBoolOption("help", "h", "Show the help menu"));
 
@@ -63,12 +131,66 @@ int main(int argc, const char** argv, const char** envp) {
     if (parser.getBool("dry-run").value_or(false))
         State::state()->m_dryRun = true;
 
+    if (parser.getBool("cgroups").value_or(false))
+        State::state()->m_useCgroups = true;
+
+    if (const auto TIMEOUT = parser.getInt("timeout"); TIMEOUT) {
+        if (*TIMEOUT <= 0) {
+            g_logger->log(LOG_ERR, "--timeout has to be positive");
+            return 1;
+        }
+
+        State::state()->m_escalation = escalationWithTimeout(*TIMEOUT);
+    }
+
+    if (const auto WAVE = parser.getInt("wave-size"); WAVE) {
+        if (*WAVE < 0) {
+            g_logger->log(LOG_ERR, "--wave-size can't be negative");
+            return 1;
+        }
+
+        State::state()->m_waveSize = *WAVE;
+    }
+
+    const auto UPDATEINTERVAL = parser.getInt("update-interval");
+    if (UPDATEINTERVAL && *UPDATEINTERVAL < 0) {
+        g_logger->log(LOG_ERR, "--update-interval can't be negative");
+        return 1;
+    }
+
+    if (const auto RULES = parser.getString("class-timeout"); RULES && !parseClassTimeouts(*RULES)) {
+        g_logger->log(LOG_ERR, "Bad --class-timeout, expected class=seconds[,class=seconds...]");
+        return 1;
+    }
+
     const auto HIS = getenv("HYPRLAND_INSTANCE_SIGNATURE");
     if (!HIS || HIS[0] == '\0') {
         g_logger->log(LOG_ERR, "Cannot run under a non-hyprland environment");
         return 1;
     }
 
+    const bool DAEMON = parser.getBool("daemon").value_or(false);
+    const bool NOUI   = parser.getBool("no-ui").value_or(false);
+
+    if (DAEMON && NOUI) {
+        g_logger->log(LOG_ERR, "--daemon keeps the overlay ready, it can't be used with --no-ui");
+        return 1;
+    }
+
+    // a waiting daemon has everything up already, hand it over. It goes by its own options though,
+    // so anything that'd make this run behave differently (--dry-run above all) has to run here instead
+    const bool OWNOPTIONS = std::ranges::any_of(LOCAL_BOOL_OPTIONS, [&parser](const auto& o) { return parser.getBool(o).value_or(false); }) ||
+        std::ranges::any_of(LOCAL_INT_OPTIONS, [&parser](const auto& o) { return parser.getInt(o).has_value(); }) ||
+        std::ranges::any_of(LOCAL_STRING_OPTIONS, [&parser](const auto& o) { return parser.getString(o).has_value(); });
+
+    if (OWNOPTIONS)
+        g_logger->log(LOG_DEBUG, "Not handing off to a daemon, running with our own options");
+
+    if (!DAEMON && !NOUI && !OWNOPTIONS && !parser.getBool("no-daemon").value_or(false) && State::CDaemonTrigger::arm()) {
+        g_logger->log(LOG_DEBUG, "Armed the running daemon");
+        return 0;
+    }
+
     // By default, hyprshutdown forks to avoid being killed when the parent terminal closes.
     // The --no-fork option runs in the foreground, useful for debugging or scripting.
     if (!parser.getBool("no-fork").value_or(false))
@@ -78,20 +200,64 @@ int main(int argc, const char** argv, const char** envp) {
         signal(SIGHUP, SIG_IGN); // Still ignore SIGHUP to survive terminal disconnect
     }
 
-    if (!State::state()->init()) {
-        g_logger->log(LOG_ERR, "Failed to init state");
-        return 1;
-    }
+    // after forking, so the socket is ours and not a dead parent's
+    if (parser.getBool("status-socket").value_or(false) || parser.getInt("status-fd")) {
+        g_statusServer = makeUnique<State::CStatusServer>();
+
+        if (parser.getBool("status-socket").value_or(false) && !g_statusServer->listen(State::CStatusServer::defaultPath()))
+            return 1;
 
-    g_ui                  = makeUnique<CUI>();
-    g_ui->m_noExit        = parser.getBool("no-exit").value_or(false) || State::state()->m_dryRun;
-    g_ui->m_shutdownLabel = parser.getString("top-label").value_or("Shutting down...");
-    g_ui->m_postExitCmd   = parser.getString("post-cmd");
+        if (const auto FD = parser.getInt("status-fd"); FD && !g_statusServer->addFd(*FD))
+            return 1;
+    }
 
     // Capture VT switch option before running UI
     auto vtSwitch = parser.getInt("vt");
+    auto report   = parser.getString("report");
+
+    bool cancelled = false;
+
+    if (NOUI) {
+        CHeadless headless;
+        headless.m_noExit      = parser.getBool("no-exit").value_or(false) || State::state()->m_dryRun;
+        headless.m_postExitCmd = parser.getString("post-cmd");
+
+        if (!headless.run())
+            return 1;
+
+        cancelled = headless.cancelled();
+    } else {
+        g_ui                  = makeUnique<CUI>();
+        g_ui->m_noExit        = parser.getBool("no-exit").value_or(false) || State::state()->m_dryRun;
+        g_ui->m_shutdownLabel = parser.getString("top-label").value_or("Shutting down...");
+        g_ui->m_postExitCmd   = parser.getString("post-cmd");
+
+        if (UPDATEINTERVAL)
+            g_ui->m_updateInterval = std::chrono::milliseconds(*UPDATEINTERVAL);
+
+        if (DAEMON) {
+            g_ui->m_trigger = makeUnique<State::CDaemonTrigger>();
+            if (!g_ui->m_trigger->listen())
+                return 1;
+        }
+
+        if (!g_ui->run())
+            return 1;
+
+        cancelled = g_ui->cancelled();
+    }
+
+    // the socket goes away with it
+    g_statusServer.reset();
+
+    logIPCStats();
+
+    if (report)
+        State::state()->writeReport(*report);
 
-    g_ui->run();
+    // a cancelled run didn't wait for anything, what's left says nothing about how long apps take
+    if (!State::state()->m_dryRun && !cancelled)
+        State::state()->saveHistory();
 
     // VT switch for NVIDIA+SDDM: after Hyprland exits, the display may not
     // automatically switch back to the greeter's VT, causing a black screen.
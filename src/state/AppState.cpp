@@ -1,11 +1,31 @@
 #include "AppState.hpp"
 #include "HyprlandIPC.hpp"
+#include "IPCTypes.hpp"
+#include "../helpers/Asserts.hpp"
 #include "../helpers/Logger.hpp"
 #include "../helpers/OS.hpp"
+#include "../helpers/Cgroup.hpp"
+#include "../helpers/ProcEvents.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
 #include <ranges>
+#include <span>
+#include <future>
+#include <iterator>
+#include <tuple>
+#include <unordered_set>
 #include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 
 #include <hyprutils/string/String.hpp>
 
@@ -15,72 +35,146 @@ static const std::vector<const char*> IGNORE_DAEMONS = {
     "Xwayland",
 };
 
-SP<CAppState> State::state() {
+// how often exits are checked for when nothing tells us about them
+constexpr float POLL_INTERVAL = 0.15F;
+// socket2 keeps us up to date, but resync once in a while in case we missed something
+constexpr float RESYNC_INTERVAL = 4.5F;
+// how long a force quit waits for the killed scopes to empty
+constexpr float KILL_TIMEOUT = 1.F;
+
+static SP<CAppState>& currentState() {
     static auto state = makeShared<CAppState>();
     return state;
 }
 
-CApp::CApp(glz::generic::object_t& object) {
-    if (object.contains("address"))
-        m_address = object["address"].get_string();
-    if (object.contains("title"))
-        m_title = object["title"].get_string();
-    if (object.contains("class"))
-        m_class = object["class"].get_string();
-    if (object.contains("namespace")) {
-        m_class        = object["namespace"].get_string();
-        m_alwaysUsePid = true; // layers cant be closewindow'd
-    }
-    if (object.contains("xwayland"))
-        m_xwayland = object["xwayland"].get_boolean();
-    if (object.contains("pid"))
-        m_pid = sc<int64_t>(object["pid"].get_number());
+SP<CAppState> State::state() {
+    return currentState();
+}
+
+void State::resetState() {
+    auto& state = currentState();
+    auto  fresh = makeShared<CAppState>();
+
+    fresh->m_dryRun          = state->m_dryRun;
+    fresh->m_useCgroups      = state->m_useCgroups;
+    fresh->m_waveSize        = state->m_waveSize;
+    fresh->m_escalation      = state->m_escalation;
+    fresh->m_classEscalation = state->m_classEscalation;
+
+    // their replies would land on the old one
+    HyprlandIPC::dropRequests();
+
+    state = fresh;
+}
+
+uint64_t CApp::nextId() {
+    // discovery jobs make apps concurrently
+    static std::atomic<uint64_t> id = 0;
+    return ++id;
+}
+
+CApp::CApp(const HyprlandIPC::SHyprClient& client) :
+    m_windows{HyprlandIPC::parseAddress(client.address)}, m_title(client.title), m_class(StringPool::intern(client.clazz)), m_pid(client.pid), m_xwayland(client.xwayland),
+    m_tier(APP_TIER_WINDOW) {
+    ;
+}
+
+CApp::CApp(const HyprlandIPC::SHyprLayer& layer) :
+    m_layers{HyprlandIPC::parseAddress(layer.address)}, m_class(StringPool::intern(layer.ns)), m_pid(layer.pid), m_alwaysUsePid(true /* layers cant be closewindow'd */),
+    m_tier(APP_TIER_LAYER) {
+    ;
 }
 
-CApp::CApp(const std::string& name, int pid) : m_class(name), m_pid(pid), m_alwaysUsePid(true) {
+CApp::CApp(const std::string& name, int pid) : m_class(StringPool::intern(name)), m_pid(pid), m_alwaysUsePid(true) {
     ;
 }
 
+bool CApp::closesWindow() const {
+    return !m_alwaysUsePid && (m_tier == APP_TIER_WINDOW || m_pid <= 0);
+}
+
+void CApp::merge(const CApp& other) {
+    m_windows.insert(m_windows.end(), other.m_windows.begin(), other.m_windows.end());
+    m_layers.insert(m_layers.end(), other.m_layers.begin(), other.m_layers.end());
+
+    if (m_title.empty())
+        m_title = other.m_title;
+
+    // one window is enough to be closed through them, the layers go with the process
+    m_xwayland     = m_xwayland || other.m_xwayland;
+    m_alwaysUsePid = m_alwaysUsePid && other.m_alwaysUsePid;
+    m_tier         = std::min(m_tier, other.m_tier);
+}
+
 void CApp::quit() {
-    if (!m_alwaysUsePid && (!m_address.empty() || m_pid <= 0)) {
-        // for apps that have an address, use closewindow. Some apps don't ask for saving on SIGTERM
-        if (m_address.empty()) {
-            g_logger->log(LOG_WARN, "CApp::quit: app {} has no address and no valid pid, skipping", m_class);
+    // apps with windows get closewindow, some don't ask for saving on SIGTERM. That's batched by CAppState::quitApps,
+    // what ends up here has no window left to close
+    if (closesWindow()) {
+        ASSERT(m_windows.empty());
+        g_logger->log(LOG_WARN, "CApp::quit: app {} has no windows and no valid pid, skipping", m_class);
+    } else {
+        // a scope: SIGTERM all of it, like systemd would on stop
+        if (!m_cgroup.empty()) {
+            g_logger->log(LOG_TRACE, "CApp::quit: using SIGTERM for scope {}", m_cgroup);
+            Cgroup::signal(m_cgroup, SIGTERM);
             return;
         }
-        g_logger->log(LOG_TRACE, "CApp::quit: using close for {}", m_class);
-        auto ret = HyprlandIPC::getFromSocket(std::format("/dispatch closewindow address:{}", m_address));
-        if (!ret)
-            g_logger->log(LOG_ERR, "Failed closing window {}: ipc err", m_class);
-        else if (*ret != "ok")
-            g_logger->log(LOG_ERR, "Failed closing window {}: {}", m_class, *ret);
-    } else {
+
         // SIGTERM with pid
         if (m_pid <= 0) {
             g_logger->log(LOG_WARN, "CApp::quit: app {} has invalid pid {}, skipping SIGTERM", m_class, m_pid);
             return;
         }
         g_logger->log(LOG_TRACE, "CApp::quit: using SIGTERM for {}, pid {}", m_class, m_pid);
-        if (::kill(m_pid, SIGTERM) != 0)
+        if (!sendSignal(SIGTERM))
             g_logger->log(LOG_ERR, "CApp::quit: signal failed for pid {}, err: {}", m_pid, strerror(errno));
     }
 }
 
 void CApp::kill() {
+    if (!m_cgroup.empty()) {
+        g_logger->log(LOG_TRACE, "CApp::kill: killing scope {}", m_cgroup);
+        if (!Cgroup::kill(m_cgroup))
+            g_logger->log(LOG_ERR, "CApp::kill: cgroup.kill failed for {}", m_cgroup);
+        return;
+    }
+
     if (m_pid <= 0) {
         g_logger->log(LOG_TRACE, "Can't kill {}: no pid", m_class);
         return;
     }
 
     g_logger->log(LOG_TRACE, "CApp::kill: killing {}, pid {}", m_class, m_pid);
-    if (::kill(m_pid, SIGKILL) != 0)
+    if (!sendSignal(SIGKILL))
         g_logger->log(LOG_ERR, "CApp::quit: signal failed for pid {}, err: {}", m_pid, strerror(errno));
+
+    signalDescendants(SIGKILL);
+}
+
+bool CApp::sendSignal(int sig) const {
+    if (m_pidfd.isValid())
+        return OS::pidfdSendSignal(m_pidfd.get(), sig);
+
+    return ::kill(m_pid, sig) == 0;
+}
+
+void CApp::signalDescendants(int sig) {
+    // only known by pid, so forget the ones that are gone before one gets recycled
+    std::erase_if(m_descendants, [](const auto& pid) { return ::kill(pid, 0) != 0 && errno == ESRCH; });
+
+    for (const auto& pid : m_descendants) {
+        ::kill(pid, sig);
+    }
 }
 
 bool CApp::appAlive() const {
-    if (m_pid <= 0)
+    if (m_pid <= 0 || m_exited)
         return false;
 
+    // the pidfd, or cgroup.events for scopes, will tell us once this isn't true anymore
+    if (m_pidfd.isValid() || !m_cgroup.empty())
+        return true;
+
     if (::kill(m_pid, 0) == 0)
         return true;
 
@@ -90,198 +184,1597 @@ bool CApp::appAlive() const {
     return false;
 }
 
-bool CApp::operator==(const glz::generic& object) const {
-    if (!object.contains("address"))
-        return false;
-
-    return m_address == object["address"].get_string();
+CAppState::~CAppState() {
+    cancelDiscovery();
+    cancelTreeScan();
 }
 
 bool CAppState::init() {
+    connectEvents();
 
-    // windows
-    {
-        const auto RET = HyprlandIPC::getFromSocket("j/clients");
+    m_discovering = true;
+    auto found    = discover(m_useCgroups);
+    m_discovering = false;
 
-        if (!RET) {
-            g_logger->log(LOG_ERR, "Couldn't get clients from socket");
-            return false;
-        }
+    return applyDiscovery(std::move(found));
+}
 
-        auto jsonRaw = glz::read_json<glz::generic>(*RET);
+void CAppState::initAsync() {
+    connectEvents();
 
-        if (!jsonRaw) {
-            g_logger->log(LOG_ERR, "Socket returned bad data");
-            return false;
-        }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        g_logger->log(LOG_WARN, "Couldn't make a pipe for the discovery thread, discovering on the main thread");
+        const bool OK = init();
+        m_events.discovered.emit(OK);
+        if (OK)
+            m_events.changed.emit();
+        return;
+    }
 
-        auto jsonArr = jsonRaw->get_array();
+    m_discoveryDone   = Hyprutils::OS::CFileDescriptor{fds[0]};
+    m_discoveryNotify = Hyprutils::OS::CFileDescriptor{fds[1]};
 
-        m_apps.reserve(jsonArr.size());
+    if (m_loop)
+        m_loop->addFd(m_discoveryDone.get(), [this] { onDiscoveryDone(); });
 
-        for (auto& el : jsonArr) {
-            m_apps.emplace_back(makeUnique<CApp>(el.get_object()));
-        }
+    m_discovering     = true;
+    m_discoveryThread = std::thread([this, useCgroups = m_useCgroups] {
+        // nothing in here touches the state, the results are handed over once we're joined
+        m_discovered = makeUnique<SDiscovery>(discover(useCgroups));
+        write(m_discoveryNotify.get(), "1", 1);
+    });
+}
+
+bool CAppState::discovering() const {
+    return m_discovering;
+}
+
+void CAppState::connectEvents() {
+    m_history.load();
+
+    // subscribe first, so that nothing that happens between our fetches and now is missed
+    m_eventSocket = makeUnique<HyprlandIPC::CEventSocket>();
+    if (!m_eventSocket->connect()) {
+        g_logger->log(LOG_WARN, "Couldn't connect to the hyprland event socket, falling back to polling");
+        m_eventSocket.reset();
+        return;
     }
 
-    // layers
-    {
-        const auto RET = HyprlandIPC::getFromSocket("j/layers");
+    if (m_loop)
+        m_loop->addFd(m_eventSocket->fd(), [this] { onEventSocket(); });
+}
 
-        if (!RET) {
-            g_logger->log(LOG_ERR, "Couldn't get layers from socket");
-            return false;
-        }
+void CAppState::onDiscoveryDone() {
+    m_loop->removeFd(m_discoveryDone.get());
 
-        auto jsonRaw = glz::read_json<glz::generic>(*RET);
+    m_discoveryThread.join();
+    m_discoveryDone.reset();
+    m_discoveryNotify.reset();
+    m_discovering = false;
 
-        if (!jsonRaw) {
-            g_logger->log(LOG_ERR, "Socket returned bad data");
-            return false;
-        }
+    auto       found = std::move(m_discovered);
+    const bool OK    = applyDiscovery(std::move(*found));
 
-        for (auto& [m, obj] : jsonRaw->get_object()) {
-            for (auto& [m2, obj2] : obj["levels"].get_object()) {
-                for (auto& el : obj2.get_array()) {
-                    m_apps.emplace_back(makeUnique<CApp>(el.get_object()));
-                }
-            }
-        }
+    m_events.discovered.emit(OK);
 
-        g_logger->log(LOG_DEBUG, "Parsed {} apps from socket", m_apps.size());
+    if (!OK)
+        return;
+
+    if (m_resyncAfterDiscovery) {
+        m_resyncAfterDiscovery = false;
+        refreshClients();
     }
 
-    // children of the Hyprland process
-    // TODO: make a kernel cgroup in hl. This can miss things.
-    // Maybe keep this for BSDs, which don't do cgroups, once we figure out PPid on BSDs.
-    {
-        const auto INSTANCES = HyprlandIPC::instances();
-        const auto HIS       = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+    m_events.changed.emit();
+}
 
-        if (HIS && HIS[0] != '\0') {
+void CAppState::cancelDiscovery() {
+    if (!m_discoveryThread.joinable())
+        return;
 
-            const HyprlandIPC::SInstanceData* instance = nullptr;
+    // IPC requests time out after 5s, so this doesn't hang forever
+    m_discoveryThread.join();
+    m_discoveryDone.reset();
+    m_discoveryNotify.reset();
+    m_discovered.reset();
+    m_discovering = false;
+}
 
-            for (const auto& I : INSTANCES) {
-                if (I.id != HIS)
-                    continue;
+CAppState::SDiscovery CAppState::discover(bool useCgroups) {
+    // the sources don't depend on each other, so fetch them all at once. Whatever owns a window or a layer
+    // is left out of the children once everything is in.
+    auto       clientsJob  = std::async(std::launch::async, [] {
+        SDiscovery found;
+        discoverClients(found);
+        return found;
+    });
+    auto       layersJob   = std::async(std::launch::async, [] {
+        SDiscovery found;
+        discoverLayers(found);
+        return found;
+    });
+    auto       childrenJob = std::async(std::launch::async, [useCgroups] {
+        SDiscovery found;
+        discoverChildren(useCgroups, found);
+        return found;
+    });
+
+    SDiscovery found    = clientsJob.get();
+    auto       layers   = layersJob.get();
+    auto       children = childrenJob.get();
+
+    // same order as doing it one after another: windows, layers, then the rest
+    for (auto& part : {&layers, &children}) {
+        std::ranges::move(part->log, std::back_inserter(found.log));
+        if (!found.error)
+            found.error = std::move(part->error);
+    }
 
-                instance = &I;
-                break;
-            }
+    if (found.error)
+        return found;
 
-            if (!instance)
-                g_logger->log(LOG_ERR, "Can't get children: no instance??");
-            else {
-                // get all processes that have a PPid of us
-                const auto PROCS = OS::getAllPids();
+    std::ranges::move(layers.apps, std::back_inserter(found.apps));
 
-                for (const auto& pid : PROCS) {
+    // a browser with 14 windows and a layer is one process to close, and one to signal
+    groupByPid(found.apps);
 
-                    // check if child
-                    if (OS::ppidOf(pid) != instance->pid)
-                        continue;
+    found.log.emplace_back(LOG_DEBUG, std::format("Parsed {} apps from socket", found.apps.size()));
 
-                    const auto NAME = OS::appNameForPid(pid);
+    found.scopes      = std::move(children.scopes);
+    found.treeRoot    = children.treeRoot;
+    found.treeIgnored = std::move(children.treeIgnored);
 
-                    if (std::ranges::contains(IGNORE_DAEMONS, NAME))
-                        continue;
+    adoptCandidates(found, children);
 
-                    m_apps.emplace_back(makeUnique<CApp>(NAME, pid));
-                }
-            }
+    // pidfds let the loop tell us about exits, instead of probing every pid each tick.
+    // Without them (old kernels, BSDs) appAlive falls back to kill(pid, 0).
+    for (const auto& app : found.apps) {
+        if (app->m_pid > 0 && app->m_cgroup.empty())
+            app->m_pidfd = OS::pidfdOpen(app->m_pid);
+    }
+
+    return found;
+}
+
+void CAppState::discoverClients(SDiscovery& found) {
+    const auto RET = HyprlandIPC::getFromSocket("j/clients");
 
-        } else
-            g_logger->log(LOG_ERR, "Can't get children: no HIS");
+    if (!RET) {
+        found.error = "Couldn't get clients from socket";
+        return;
     }
 
-    // exit them if not dry run
-    if (!m_dryRun) {
-        for (const auto& e : m_apps) {
-            e->quit();
-        }
+    const auto CLIENTS = HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClient>>(*RET);
+
+    if (!CLIENTS) {
+        found.error = "Socket returned bad data";
+        return;
     }
 
-    return true;
+    found.apps.reserve(CLIENTS->size());
+    found.clients.reserve(CLIENTS->size());
+
+    for (const auto& client : *CLIENTS) {
+        found.apps.emplace_back(makeUnique<CApp>(client));
+        found.clients.emplace_back(HyprlandIPC::parseAddress(client.address), client.pid);
+    }
 }
 
-const std::vector<UP<CApp>>& CAppState::apps() const {
-    return m_apps;
+void CAppState::discoverLayers(SDiscovery& found) {
+    const auto RET = HyprlandIPC::getFromSocket("j/layers");
+
+    if (!RET) {
+        found.error = "Couldn't get layers from socket";
+        return;
+    }
+
+    const auto LAYERS = HyprlandIPC::parse<HyprlandIPC::CHyprLayers>(*RET);
+
+    if (!LAYERS) {
+        found.error = "Socket returned bad data";
+        return;
+    }
+
+    for (const auto& [monitor, layers] : *LAYERS) {
+        for (const auto& [level, levelLayers] : layers.levels) {
+            for (const auto& layer : levelLayers) {
+                found.apps.emplace_back(makeUnique<CApp>(layer));
+            }
+        }
+    }
 }
 
-float CAppState::secondsPassed() const {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started).count() / 1000.F;
+void CAppState::discoverChildren(bool useCgroups, SDiscovery& found) {
+    // everything else hyprland launched: either its cgroups if asked to, or the process tree under it.
+    // The tree walk can miss things, but it's all BSDs have.
+    auto& client = HyprlandIPC::client();
+
+    if (!client.valid()) {
+        found.log.emplace_back(LOG_ERR, "Can't get children: no HIS");
+        return;
+    }
+
+    const auto INSTANCE = client.instance();
+
+    if (!INSTANCE) {
+        found.log.emplace_back(LOG_ERR, "Can't get children: no instance??");
+        return;
+    }
+
+    if (!useCgroups || !discoverCgroups(INSTANCE->pid, found))
+        discoverTree(INSTANCE->pid, found);
 }
 
-bool CAppState::updateState() {
-    const auto RET = HyprlandIPC::getFromSocket("j/clients");
+bool CAppState::applyDiscovery(SDiscovery&& found) {
+    for (const auto& [level, message] : found.log) {
+        g_logger->log(level, "{}", message);
+    }
 
-    if (!RET) {
-        g_logger->log(LOG_ERR, "Couldn't get clients from socket");
+    if (found.error) {
+        g_logger->log(LOG_ERR, "{}", *found.error);
         return false;
     }
 
-    auto jsonRaw = glz::read_json<glz::generic>(*RET);
+    m_apps = std::move(found.apps);
 
-    if (!jsonRaw) {
-        g_logger->log(LOG_ERR, "Socket returned bad data");
-        return false;
+    m_clientPids.reserve(found.clients.size());
+    for (const auto& [address, pid] : found.clients) {
+        // closed while we were looking
+        if (m_closedDuringRefresh.contains(address))
+            continue;
+
+        addClient(address, pid);
     }
 
-    auto       table = jsonRaw->get_array();
+    if (!m_clientsInFlight)
+        m_closedDuringRefresh.clear();
+
+    m_scopes = std::move(found.scopes);
 
-    const auto BEFORE = m_apps.size();
+#if defined(__linux__)
+    // cgroup.events gets a modify event whenever populated changes
+    if (!m_scopes.empty()) {
+        m_cgroupEvents = Hyprutils::OS::CFileDescriptor{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)};
+        if (m_cgroupEvents.isValid()) {
+            for (const auto& scope : m_scopes) {
+                inotify_add_watch(m_cgroupEvents.get(), (scope.path + "/cgroup.events").c_str(), IN_MODIFY);
+            }
+        }
+    }
+#endif
 
-    std::erase_if(m_apps, [&table](const auto& e) { return !e->appAlive() && !std::ranges::any_of(table, [&e](const auto& te) { return te == *e; }); });
+    if (m_loop) {
+        if (m_cgroupEvents.isValid())
+            m_loop->addFd(m_cgroupEvents.get(), [this] { onCgroupEvents(); });
 
-    // check PIDs
-    if (!m_dryRun) {
         for (const auto& app : m_apps) {
-            if (!app->appAlive() || app->m_pid <= 0 || app->m_address.empty() /* not a window */ || std::ranges::contains(m_pidsTermedNoWindows, app->m_pid))
+            watchPidfd(app);
+        }
+    }
+
+    if (found.treeRoot > 0) {
+        m_treeRoot = found.treeRoot;
+        m_tree.insert(found.tree.begin(), found.tree.end());
+        m_treeIgnored.insert(found.treeIgnored.begin(), found.treeIgnored.end());
+
+        startProcEvents();
+    }
+
+    rebuildHot();
+
+    m_nextResync = secondsPassed() + RESYNC_INTERVAL;
+
+    // exit them if not dry run
+    if (closing())
+        fillWave();
+
+    return true;
+}
+
+void CAppState::groupByPid(std::vector<UP<CApp>>& apps) {
+    std::unordered_map<int64_t, CApp*> byPid;
+    byPid.reserve(apps.size());
+
+    for (auto& app : apps) {
+        // without a pid there's no telling what belongs together
+        if (app->m_pid <= 0)
+            continue;
+
+        const auto [IT, INSERTED] = byPid.emplace(app->m_pid, app.get());
+        if (INSERTED)
+            continue;
+
+        IT->second->merge(*app);
+        app.reset();
+    }
+
+    // merged into the first app with their pid
+    std::erase_if(apps, [](const auto& app) { return !app; });
+}
+
+void CAppState::adoptCandidates(SDiscovery& found, SDiscovery& children) {
+    // whatever owns a window or a layer
+    std::unordered_map<int64_t, CApp*> owners;
+    for (const auto& app : found.apps) {
+        if (app->m_pid > 0)
+            owners.emplace(app->m_pid, app.get());
+    }
+
+    const std::unordered_map<int64_t, int64_t> PARENTS{children.parents.begin(), children.parents.end()};
+
+    // pid -> the owner it runs under, nullptr if none. Memoized along each chain walked, so O(n) in all
+    std::unordered_map<int64_t, CApp*> ownerOf;
+    ownerOf.reserve(PARENTS.size());
+
+    std::vector<int64_t> chain;
+    const auto           resolve = [&](int64_t pid) -> CApp* {
+        CApp* owner = nullptr;
+
+        chain.clear();
+        for (int64_t p = pid;;) {
+            if (const auto IT = ownerOf.find(p); IT != ownerOf.end()) {
+                owner = IT->second;
+                break;
+            }
+
+            chain.emplace_back(p);
+
+            const auto PARENT = PARENTS.find(p);
+            if (PARENT == PARENTS.end())
+                break;
+
+            if (const auto IT = owners.find(PARENT->second); IT != owners.end()) {
+                owner = IT->second;
+                break;
+            }
+
+            p = PARENT->second;
+        }
+
+        for (const auto& c : chain) {
+            ownerOf.emplace(c, owner);
+        }
+
+        return owner;
+    };
+
+    for (auto& candidate : children.candidates) {
+        // owns a window or a layer itself
+        if (std::ranges::any_of(candidate.pids, [&owners](const auto& pid) { return owners.contains(pid); }))
+            continue;
+
+        // closing the owner takes care of it, a SIGTERM now would beat its save prompt
+        if (candidate.app->m_cgroup.empty()) {
+            if (const auto OWNER = resolve(candidate.app->m_pid)) {
+                OWNER->m_descendants.emplace_back(candidate.app->m_pid);
                 continue;
+            }
+        }
+
+        found.apps.emplace_back(std::move(candidate.app));
+    }
 
-            const bool HAS_ANY_WINDOWS = std::ranges::any_of(table, [&app](const auto& te) {
-                if (!te.contains("pid"))
-                    return false;
+    found.tree = std::move(children.tree);
+    for (auto& [pid, owner] : found.tree) {
+        if (owners.contains(pid))
+            owner = pid;
+        else if (const auto OWNER = resolve(pid))
+            owner = OWNER->m_pid;
+        else
+            owner = 0;
+    }
+}
+
+void CAppState::discoverTree(int64_t hlPid, SDiscovery& found) {
+    // get the whole process tree under us, not only direct children: anything launched
+    // through a shell, uwsm or a terminal is a grandchild.
+    const OS::CProcessSnapshot PROCS;
+
+    const int64_t       SELF = getpid();
+    std::vector<size_t> stack;
 
-                return sc<int>(te["pid"].get_number()) == app->m_pid;
-            });
+    found.treeRoot = hlPid;
 
-            if (HAS_ANY_WINDOWS)
+    for (const auto& TOP : PROCS.childrenOf(hlPid)) {
+        stack.clear();
+        stack.emplace_back(TOP);
+
+        while (!stack.empty()) {
+            const auto& PROC = PROCS.processes()[stack.back()];
+            stack.pop_back();
+
+            // ignored daemons take their whole subtree with them. So do we, if we were ran with --no-fork from under hyprland.
+            if (PROC.pid == SELF || std::ranges::contains(IGNORE_DAEMONS, PROC.name)) {
+                found.treeIgnored.emplace_back(PROC.pid);
                 continue;
+            }
 
-            // app has no windows, but is alive. Send a SIGTERM.
-            // TODO: maybe make this also repeat every 5s or so?
-            m_pidsTermedNoWindows.emplace_back(app->m_pid);
+            // who it belongs to is only known once the windows and layers are in
+            found.tree.emplace_back(PROC.pid, 0);
+            found.parents.emplace_back(PROC.pid, PROC.ppid);
 
-            g_logger->log(LOG_DEBUG, "App {} with pid {} window was closed, but pid is alive. Sending SIGTERM.", app->m_class, app->m_pid);
-            kill(app->m_pid, SIGTERM);
+            const auto CHILDREN = PROCS.childrenOf(PROC.pid);
+            stack.insert(stack.end(), CHILDREN.rbegin(), CHILDREN.rend());
+
+            // processes owning a window or a layer get dropped later, what runs under them goes with them
+            found.candidates.emplace_back(SCandidate{.app = makeUnique<CApp>(PROC.name, PROC.pid), .pids = {PROC.pid}});
         }
     }
+}
 
-    g_logger->log(LOG_DEBUG, "Updated state: apps size {}", m_apps.size());
+bool CAppState::discoverCgroups(int64_t hlPid, SDiscovery& found) {
+    const auto SESSION = Cgroup::cgroupOf(hlPid);
+
+    if (!SESSION) {
+        found.log.emplace_back(LOG_WARN, "No cgroup v2 hierarchy, falling back to the process tree");
+        return false;
+    }
+
+    // uwsm names units after the first desktop in XDG_CURRENT_DESKTOP
+    const auto  XDGDESKTOP = getenv("XDG_CURRENT_DESKTOP");
+    std::string desktop    = XDGDESKTOP && XDGDESKTOP[0] != '\0' ? XDGDESKTOP : "Hyprland";
+    desktop                = desktop.substr(0, desktop.find(':'));
+
+    const auto SELF   = getpid();
+    const auto SELFCG = Cgroup::cgroupOf(SELF).value_or("");
+
+    // whatever shares hyprland's cgroup, minus hyprland itself and what's above it,
+    // which is the case when hyprland was started straight from a login session
+    std::unordered_set<int64_t> skip{hlPid, SELF};
+    for (int64_t pid = OS::ppidOf(hlPid); pid > 1 && skip.emplace(pid).second; pid = OS::ppidOf(pid)) {
+        ;
+    }
+
+    for (const auto& pid : Cgroup::procs(*SESSION)) {
+        if (skip.contains(pid))
+            continue;
+
+        const auto NAME = OS::appNameForPid(pid);
+
+        if (std::ranges::contains(IGNORE_DAEMONS, NAME))
+            continue;
+
+        found.candidates.emplace_back(SCandidate{.app = makeUnique<CApp>(NAME, pid), .pids = {pid}});
+        found.parents.emplace_back(pid, OS::ppidOf(pid));
+    }
+
+    for (const auto& scope : Cgroup::appScopes(*SESSION, desktop)) {
+        // don't take ourselves down, e.g. when ran through uwsm app
+        if (!SELFCG.empty() && (SELFCG == scope || SELFCG.starts_with(scope + "/")))
+            continue;
 
-    return BEFORE != m_apps.size();
+        const auto PROCS = Cgroup::procs(scope);
+        if (PROCS.empty())
+            continue;
+
+        found.scopes.emplace_back(SScope{.path = scope});
+
+        // scopes with windows are already shown through those, we only need to know about them for force quitting
+        auto app      = makeUnique<CApp>(Cgroup::appNameForScope(scope, desktop), PROCS.front());
+        app->m_cgroup = scope;
+        found.candidates.emplace_back(SCandidate{.app = std::move(app), .pids = PROCS});
+    }
+
+    found.log.emplace_back(LOG_DEBUG, std::format("Found {} app scopes in {}", found.scopes.size(), *SESSION));
+
+    return true;
 }
 
-void CAppState::killAllApps() const {
-    if (m_dryRun) {
-        g_logger->log(LOG_TRACE, "CAppState::killAllApps: ignoring, dry run");
+void CAppState::refreshScopes() {
+    for (size_t i = 0; i < m_apps.size(); ++i) {
+        const auto& APP = m_apps[i];
+        if (!APP->m_cgroup.empty() && !APP->m_exited && !Cgroup::populated(APP->m_cgroup))
+            markExited(i);
+    }
+}
+
+void CAppState::onCgroupEvents() {
+    drainCgroupEvents();
+    refreshScopes();
+    checkKilled();
+    reconcile();
+}
+
+void CAppState::drainCgroupEvents() const {
+    // we re-read the scopes anyways, the events themselves don't matter
+    char buffer[4096];
+    while (read(m_cgroupEvents.get(), buffer, sizeof(buffer)) > 0) {
+        ;
+    }
+}
+
+void CAppState::checkKilled() {
+    if (!m_killDeadline)
         return;
+
+    // cgroup.events says populated 0 once everything in a scope is actually gone, and wakes us up through onCgroupEvents
+    const bool POPULATED = std::ranges::any_of(m_scopes, [](const auto& s) { return Cgroup::populated(s.path); });
+
+    if (POPULATED && m_cgroupEvents.isValid() && secondsPassed() < *m_killDeadline)
+        return;
+
+    if (POPULATED)
+        g_logger->log(LOG_WARN, "CAppState::checkKilled: scopes still populated, giving up");
+
+    m_killDeadline.reset();
+    m_events.killed.emit();
+}
+
+const std::vector<UP<CApp>>& CAppState::apps() const {
+    return m_apps;
+}
+
+CTelemetry& CAppState::telemetry() {
+    return m_telemetry;
+}
+
+bool CAppState::writeReport(const std::string& path) {
+    std::vector<const CApp*> remaining;
+    remaining.reserve(m_apps.size());
+    for (const auto& a : m_apps) {
+        remaining.emplace_back(a.get());
     }
 
+    return m_telemetry.write(path, remaining, secondsPassed());
+}
+
+bool CAppState::saveHistory() {
+    // same as reconcile: only what was asked to quit and then had to be signaled needed escalating.
+    // The rest just hadn't exited yet, or never got the chance before a force quit
     for (const auto& a : m_apps) {
-        a->kill();
+        if (a->m_quitAt && (a->m_termed || a->m_killed || m_pidsTermedNoWindows.contains(a->m_pid)))
+            m_history.recordEscalation(a->m_class);
     }
+
+    return m_history.save();
 }
 
-void CAppState::reexitApps() const {
-    if (m_dryRun) {
-        g_logger->log(LOG_TRACE, "CAppState::reexitApps: ignoring, dry run");
+float CAppState::secondsPassed() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started).count() / 1000.F;
+}
+
+void CAppState::restartClock() {
+    m_started = std::chrono::steady_clock::now();
+
+    // due on the old clock, and catching up on whatever happened since the last one doesn't hurt
+    m_nextResync = 0;
+}
+
+void CAppState::setDormant(bool dormant) {
+    if (m_dormant == dormant)
+        return;
+
+    m_dormant = dormant;
+    m_openedWindows.clear();
+
+    // discovery starts closing once it's done
+    if (!m_dormant && !m_discovering)
+        fillWave();
+}
+
+bool CAppState::dormant() const {
+    return m_dormant;
+}
+
+bool CAppState::closing() const {
+    return !m_dryRun && !m_dormant;
+}
+
+void CAppState::refreshClients() {
+    // one in flight is enough, its result is as fresh as it gets. It fails within 5s if hyprland never answers
+    if (m_clientsInFlight)
         return;
+
+    m_clientsInFlight = true;
+
+    HyprlandIPC::getFromSocketAsync(m_loop, "j/clients", [this](std::expected<std::string_view, std::string> ret) {
+        m_clientsInFlight = false;
+
+        if (!ret) {
+            m_closedDuringRefresh.clear();
+            g_logger->log(LOG_ERR, "Couldn't get clients from socket: {}", ret.error());
+            return;
+        }
+
+        if (!applyClients(*ret))
+            return;
+
+        if (m_dormant)
+            adoptClients();
+
+        reconcile();
+    });
+}
+
+bool CAppState::applyClients(std::string_view json) {
+    const auto CLIENTS = HyprlandIPC::parse<std::vector<HyprlandIPC::SHyprClientRef>>(json);
+
+    if (!CLIENTS) {
+        g_logger->log(LOG_ERR, "Socket returned bad data");
+        return false;
     }
 
+    m_clientPids.clear();
+    m_windowsPerPid.clear();
+
+    for (const auto& client : *CLIENTS) {
+        const auto ADDRESS = HyprlandIPC::parseAddress(client.address);
+
+        // closed while the reply was on its way, don't resurrect it
+        if (m_closedDuringRefresh.contains(ADDRESS))
+            continue;
+
+        addClient(ADDRESS, client.pid);
+    }
+
+    m_closedDuringRefresh.clear();
+
+    return true;
+}
+
+void CAppState::adoptClients() {
+    std::unordered_set<uint64_t> known;
+    for (const auto& app : m_apps) {
+        known.insert(app->m_windows.begin(), app->m_windows.end());
+    }
+
+    bool changed = false;
+    for (const auto& [address, pid] : m_clientPids) {
+        if (known.contains(address))
+            continue;
+
+        std::string clazz, title;
+        if (const auto IT = m_openedWindows.find(address); IT != m_openedWindows.end())
+            std::tie(clazz, title) = IT->second;
+        else if (pid > 0)
+            clazz = OS::appNameForPid(pid);
+
+        const auto ADDRESS = std::format("0x{:x}", address);
+        auto       app     = makeUnique<CApp>(HyprlandIPC::SHyprClient{.address = ADDRESS, .title = std::move(title), .clazz = std::move(clazz), .pid = pid});
+
+        changed = true;
+
+        // a process we know opening a window gets closed through it, like discovery's groupByPid would have it
+        if (const auto OWNER = pid > 0 ? std::ranges::find(m_apps, pid, &CApp::m_pid) : m_apps.end(); OWNER != m_apps.end()) {
+            (*OWNER)->merge(*app);
+            if (const auto TREE = m_tree.find(pid); TREE != m_tree.end())
+                TREE->second = pid;
+            continue;
+        }
+
+        g_logger->log(LOG_DEBUG, "{} opened a window while dormant, it'll be closed too", app->m_class);
+
+        if (pid > 0)
+            app->m_pidfd = OS::pidfdOpen(pid);
+        watchPidfd(m_apps.emplace_back(std::move(app)));
+    }
+
+    std::erase_if(m_openedWindows, [this](const auto& e) { return m_clientPids.contains(e.first); });
+
+    if (!changed)
+        return;
+
+    rebuildHot();
+    m_events.changed.emit();
+}
+
+void CAppState::addClient(uint64_t address, int64_t pid) {
+    if (!m_clientPids.emplace(address, pid).second)
+        return;
+
+    m_windowsPerPid[pid]++;
+}
+
+void CAppState::removeClient(uint64_t address) {
+    const auto IT = m_clientPids.find(address);
+    if (IT == m_clientPids.end())
+        return;
+
+    if (const auto COUNT = m_windowsPerPid.find(IT->second); COUNT != m_windowsPerPid.end() && --COUNT->second == 0)
+        m_windowsPerPid.erase(COUNT);
+
+    m_clientPids.erase(IT);
+}
+
+bool CAppState::updateState() {
+    // with socket2, the client list is kept up to date by events. Without it, we have to poll.
+    // The reply gets reconciled once it arrives, meanwhile go with what we have.
+    if (!m_eventSocket)
+        refreshClients();
+
+    return reconcile();
+}
+
+void CAppState::rebuildHot() {
+    m_hot.pids.clear();
+    m_hot.windows.clear();
+    m_hot.flags.clear();
+
+    m_hot.pids.reserve(m_apps.size());
+    m_hot.windows.reserve(m_apps.size());
+    m_hot.flags.reserve(m_apps.size());
+
+    for (const auto& app : m_apps) {
+        uint8_t flags = 0;
+        // proc events report exits of anything in the tree
+        if (app->m_pidfd.isValid() || !app->m_cgroup.empty() || (m_procEvents && m_tree.contains(app->m_pid)))
+            flags |= HOT_WATCHED;
+        if (app->m_exited)
+            flags |= HOT_EXITED;
+        if (app->m_tier == APP_TIER_WINDOW)
+            flags |= HOT_WINDOWED;
+
+        m_hot.pids.emplace_back(app->m_pid);
+        m_hot.windows.emplace_back(app->m_windows.size());
+        m_hot.flags.emplace_back(flags);
+    }
+}
+
+bool CAppState::hotAlive(size_t idx) const {
+    const auto PID   = m_hot.pids[idx];
+    const auto FLAGS = m_hot.flags[idx];
+
+    if (PID <= 0 || (FLAGS & HOT_EXITED))
+        return false;
+
+    if (FLAGS & HOT_WATCHED)
+        return true;
+
+    return ::kill(PID, 0) == 0 || errno == EPERM;
+}
+
+void CAppState::markExited(size_t idx) {
+    m_apps[idx]->m_exited = true;
+    m_hot.flags[idx] |= HOT_EXITED;
+}
+
+bool CAppState::reconcile() {
+    // without inotify, scopes have to be polled
+    if (!m_scopes.empty() && !m_cgroupEvents.isValid())
+        refreshScopes();
+
+    // windows that closed drop out of their app, which changes what it shows but doesn't remove it
+    bool windowsChanged = false;
+
+    // what outlived the app it ran under
+    std::vector<int64_t> orphans;
+
+    // dead, and not holding on to a window either
+    size_t kept = 0;
+    for (size_t i = 0; i < m_apps.size(); ++i) {
+        if (m_hot.windows[i] > 0) {
+            auto& windows = m_apps[i]->m_windows;
+            if (std::erase_if(windows, [this](const auto& address) { return !m_clientPids.contains(address); }) > 0) {
+                m_hot.windows[i] = sc<uint32_t>(windows.size());
+                windowsChanged   = true;
+            }
+        }
+
+        if (hotAlive(i) || m_hot.windows[i] > 0) {
+            if (kept != i)
+                m_apps[kept] = std::move(m_apps[i]);
+            kept++;
+            continue;
+        }
+
+        const auto& e = m_apps[i];
+
+        if (m_loop && e->m_pidfd.isValid() && !e->m_exited)
+            m_loop->removeFd(e->m_pidfd.get());
+
+        // dormant, nobody asked it to
+        if (!m_dormant)
+            m_telemetry.onExited(*e, secondsPassed());
+
+        for (const auto& pid : e->m_descendants) {
+            if (::kill(pid, 0) == 0 || errno == EPERM)
+                orphans.emplace_back(pid);
+        }
+
+        if (e->m_quitAt) {
+            if (e->m_termed || e->m_killed || m_pidsTermedNoWindows.contains(e->m_pid))
+                m_history.recordEscalation(e->m_class);
+            else
+                m_history.recordExit(e->m_class, secondsPassed() - *e->m_quitAt);
+        }
+    }
+
+    const bool REMOVED = kept != m_apps.size();
+    if (REMOVED)
+        m_apps.erase(m_apps.begin() + kept, m_apps.end());
+
+    // nothing closes those for us anymore, they're apps of their own now
+    bool adopted = false;
+    for (const auto& pid : orphans) {
+        m_tree.insert_or_assign(pid, 0);
+        adopted |= addSpawned(pid, 0, OS::appNameForPid(pid));
+    }
+
+    if (REMOVED || adopted)
+        rebuildHot();
+
+    // check PIDs
+    if (closing()) {
+        for (size_t i = 0; i < m_apps.size(); ++i) {
+            const auto PID = m_hot.pids[i];
+
+            if (!hotAlive(i) || PID <= 0 || !(m_hot.flags[i] & HOT_WINDOWED) || m_pidsTermedNoWindows.contains(PID))
+                continue;
+
+            if (m_windowsPerPid.contains(PID))
+                continue;
+
+            // app has no windows, but is alive. Send a SIGTERM.
+            m_pidsTermedNoWindows.emplace(PID);
+
+            const auto& app = m_apps[i];
+            g_logger->log(LOG_DEBUG, "App {} with pid {} window was closed, but pid is alive. Sending SIGTERM.", app->m_class, PID);
+            app->sendSignal(SIGTERM);
+            m_telemetry.onTermedNoWindows(*app);
+        }
+    }
+
+    g_logger->log(LOG_DEBUG, "Updated state: apps size {}", m_apps.size());
+
+    if (!REMOVED && !adopted) {
+        if (windowsChanged)
+            m_events.changed.emit();
+        return false;
+    }
+
+    // exits free up room in the wave, orphans need asking
+    if (m_waveSize > 0 || adopted)
+        fillWave();
+
+    m_events.changed.emit();
+    return true;
+}
+
+void CAppState::setEventLoop(SP<IEventLoop> loop) {
+    if (m_loop) {
+        if (m_eventSocket)
+            m_loop->removeFd(m_eventSocket->fd());
+
+        if (m_cgroupEvents.isValid())
+            m_loop->removeFd(m_cgroupEvents.get());
+
+        if (m_discoveryDone.isValid())
+            m_loop->removeFd(m_discoveryDone.get());
+
+        if (m_treeScanDone.isValid())
+            m_loop->removeFd(m_treeScanDone.get());
+
+        if (m_procEvents)
+            m_loop->removeFd(m_procEvents->fd());
+
+        for (const auto& app : m_apps) {
+            if (app->m_pidfd.isValid() && !app->m_exited)
+                m_loop->removeFd(app->m_pidfd.get());
+        }
+    }
+
+    m_loop = loop;
+
+    // nothing would ever pick the results up
+    if (!m_loop) {
+        cancelDiscovery();
+        cancelTreeScan();
+        return;
+    }
+
+    if (m_discoveryDone.isValid())
+        m_loop->addFd(m_discoveryDone.get(), [this] { onDiscoveryDone(); });
+
+    if (m_treeScanDone.isValid())
+        m_loop->addFd(m_treeScanDone.get(), [this] { onTreeScanDone(); });
+
+    if (m_eventSocket)
+        m_loop->addFd(m_eventSocket->fd(), [this] { onEventSocket(); });
+
+    if (m_cgroupEvents.isValid())
+        m_loop->addFd(m_cgroupEvents.get(), [this] { onCgroupEvents(); });
+
+    if (m_procEvents)
+        m_loop->addFd(m_procEvents->fd(), [this] { onProcEvents(); });
+
+    for (const auto& app : m_apps) {
+        watchPidfd(app);
+    }
+}
+
+void CAppState::watchPidfd(const UP<CApp>& app) {
+    if (!m_loop || !app->m_pidfd.isValid() || app->m_exited)
+        return;
+
+    // a pidfd becomes readable once the process exits
+    m_loop->addFd(app->m_pidfd.get(), [this, fd = app->m_pidfd.get()] { onPidfd(fd); });
+}
+
+void CAppState::onPidfd(int fd) {
+    m_loop->removeFd(fd);
+
+    const auto IT = std::ranges::find_if(m_apps, [fd](const auto& e) { return e->m_pidfd.get() == fd; });
+
+    if (IT == m_apps.end())
+        return;
+
+    g_logger->log(LOG_TRACE, "CAppState::onPidfd: {} with pid {} exited", (*IT)->m_class, (*IT)->m_pid);
+
+    markExited(IT - m_apps.begin());
+
+    reconcile();
+}
+
+void CAppState::startProcEvents() {
+    m_procEvents = makeUnique<OS::CProcEvents>();
+
+    if (!m_procEvents->open()) {
+        g_logger->log(LOG_DEBUG, "No proc connector, rescanning the process tree for new processes instead");
+        m_procEvents.reset();
+        return;
+    }
+
+    if (m_loop)
+        m_loop->addFd(m_procEvents->fd(), [this] { onProcEvents(); });
+
+    // whatever came and went between the snapshot and subscribing
+    for (const auto& app : m_apps) {
+        if (!app->m_pidfd.isValid() && app->m_cgroup.empty() && m_tree.contains(app->m_pid) && ::kill(app->m_pid, 0) != 0 && errno == ESRCH)
+            app->m_exited = true;
+    }
+
+    // the exits above, and everything in the tree is watched now
+    rebuildHot();
+
+    rescanTree();
+}
+
+bool CAppState::addSpawned(int64_t pid, int64_t owner, const std::string& name) {
+    if (name.empty())
+        return false;
+
+    if (std::ranges::contains(IGNORE_DAEMONS, name)) {
+        m_treeIgnored.emplace(pid);
+        return false;
+    }
+
+    // under an app owning a window or a layer: it goes with that one, e.g. a helper spawned while saving.
+    // If that app is gone already, nobody closes it for us
+    if (owner > 0 && owner != pid) {
+        if (const auto OWNER = std::ranges::find(m_apps, owner, &CApp::m_pid); OWNER != m_apps.end()) {
+            m_tree.emplace(pid, owner);
+            (*OWNER)->m_descendants.emplace_back(pid);
+            g_logger->log(LOG_DEBUG, "{} (pid {}) showed up under {}, it goes with it", name, pid, (*OWNER)->m_class);
+            return false;
+        }
+
+        owner = 0;
+    }
+
+    m_tree.emplace(pid, owner);
+
+    if (std::ranges::any_of(m_apps, [pid](const auto& e) { return e->m_pid == pid; }))
+        return false;
+
+    g_logger->log(LOG_DEBUG, "{} (pid {}) showed up under hyprland, closing it too", name, pid);
+
+    auto& app    = m_apps.emplace_back(makeUnique<CApp>(name, pid));
+    app->m_pidfd = OS::pidfdOpen(pid);
+    watchPidfd(app);
+
+    return true;
+}
+
+void CAppState::rescanTree() {
+    // one at a time, the one running sees what a second would
+    if (m_treeRoot <= 0 || m_treeScanThread.joinable())
+        return;
+
+    int fds[2];
+    if (!m_loop || pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        applyTreeScan(scanTree(m_treeRoot, m_tree, m_treeIgnored));
+        return;
+    }
+
+    m_treeScanDone   = Hyprutils::OS::CFileDescriptor{fds[0]};
+    m_treeScanNotify = Hyprutils::OS::CFileDescriptor{fds[1]};
+
+    m_loop->addFd(m_treeScanDone.get(), [this] { onTreeScanDone(); });
+
+    // it reads /proc per pid we know about, or the whole process table on BSDs. Not something to block the UI on
+    m_treeScanThread = std::thread([this, root = m_treeRoot, tree = m_tree, ignored = m_treeIgnored]() mutable {
+        m_treeScanned = makeUnique<STreeScan>(scanTree(root, std::move(tree), std::move(ignored)));
+        write(m_treeScanNotify.get(), "1", 1);
+    });
+}
+
+CAppState::STreeScan CAppState::scanTree(int64_t root, std::unordered_map<int64_t, int64_t> tree, std::unordered_set<int64_t> ignored) {
+    const int64_t SELF = getpid();
+    STreeScan     scan;
+
+    // only read the children of what we know about. Without per-process children lists, one full snapshot has to do
+    std::optional<OS::CProcessSnapshot> procs;
+    if (!OS::childPids(root))
+        procs.emplace();
+
+    const auto childrenOf = [&procs](int64_t pid) {
+        if (!procs)
+            return OS::childPids(pid).value_or(std::vector<int64_t>{});
+
+        std::vector<int64_t> result;
+        for (const auto& idx : procs->childrenOf(pid)) {
+            result.emplace_back(procs->processes()[idx].pid);
+        }
+
+        return result;
+    };
+
+    std::erase_if(tree, [&scan](const auto& e) {
+        if (::kill(e.first, 0) == 0 || errno != ESRCH)
+            return false;
+        scan.gone.emplace_back(e.first);
+        return true;
+    });
+    std::erase_if(ignored, [&scan](const auto& pid) {
+        if (::kill(pid, 0) == 0 || errno != ESRCH)
+            return false;
+        scan.goneIgnored.emplace_back(pid);
+        return true;
+    });
+
+    std::vector<std::pair<int64_t, int64_t>> stack; // pid, owner
+    for (const auto& child : childrenOf(root)) {
+        stack.emplace_back(child, 0);
+    }
+
+    while (!stack.empty()) {
+        auto [pid, owner] = stack.back();
+        stack.pop_back();
+
+        if (pid == SELF || ignored.contains(pid))
+            continue;
+
+        if (const auto IT = tree.find(pid); IT != tree.end())
+            owner = IT->second;
+        else {
+            auto name = OS::appNameForPid(pid);
+            if (name.empty())
+                continue; // gone
+
+            // still handed over, so it gets remembered as ignored. Nothing under it is ours
+            const bool IGNORED = std::ranges::contains(IGNORE_DAEMONS, name);
+            scan.spawned.emplace_back(STreeScan::SSpawned{.pid = pid, .owner = owner, .name = std::move(name)});
+
+            if (IGNORED)
+                continue;
+
+            tree.emplace(pid, owner);
+        }
+
+        for (const auto& child : childrenOf(pid)) {
+            stack.emplace_back(child, owner);
+        }
+    }
+
+    return scan;
+}
+
+void CAppState::onTreeScanDone() {
+    m_loop->removeFd(m_treeScanDone.get());
+
+    m_treeScanThread.join();
+    m_treeScanDone.reset();
+    m_treeScanNotify.reset();
+
+    auto scan = std::move(m_treeScanned);
+    applyTreeScan(std::move(*scan));
+}
+
+void CAppState::cancelTreeScan() {
+    if (!m_treeScanThread.joinable())
+        return;
+
+    m_treeScanThread.join();
+    m_treeScanDone.reset();
+    m_treeScanNotify.reset();
+    m_treeScanned.reset();
+}
+
+void CAppState::applyTreeScan(STreeScan&& scan) {
+    for (const auto& pid : scan.gone) {
+        m_tree.erase(pid);
+    }
+
+    for (const auto& pid : scan.goneIgnored) {
+        m_treeIgnored.erase(pid);
+    }
+
+    bool added = false;
+    for (const auto& spawned : scan.spawned) {
+        // proc events can have been faster
+        if (m_tree.contains(spawned.pid) || m_treeIgnored.contains(spawned.pid))
+            continue;
+
+        added |= addSpawned(spawned.pid, spawned.owner, spawned.name);
+    }
+
+    if (!added)
+        return;
+
+    rebuildHot();
+
+    if (closing())
+        fillWave();
+
+    m_events.changed.emit();
+}
+
+void CAppState::onProcEvents() {
+    const int64_t SELF    = getpid();
+    bool          added   = false;
+    bool          changed = false;
+    bool          exited  = false;
+
+    const bool    ALIVE = m_procEvents->dispatch([&](const OS::CProcEvents::SEvent& event) {
+        switch (event.type) {
+            case OS::CProcEvents::PROC_EVENT_TYPE_FORK: {
+                if (event.pid == SELF)
+                    return;
+
+                // children of hyprland run on their own, the rest inherit whoever their parent belongs to
+                int64_t owner = 0;
+                if (event.ppid != m_treeRoot) {
+                    const auto IT = m_tree.find(event.ppid);
+                    if (IT == m_tree.end())
+                        return;
+                    owner = IT->second;
+                }
+
+                added |= addSpawned(event.pid, owner, OS::appNameForPid(event.pid));
+                break;
+            }
+            case OS::CProcEvents::PROC_EVENT_TYPE_EXEC: {
+                if (!m_tree.contains(event.pid))
+                    return;
+
+                const auto IT = std::ranges::find(m_apps, event.pid, &CApp::m_pid);
+                if (IT == m_apps.end())
+                    return;
+
+                auto&      app  = *IT;
+
+                // a fork still has its parent's name
+                const auto NAME = OS::appNameForPid(event.pid);
+
+                if (std::ranges::contains(IGNORE_DAEMONS, NAME)) {
+                    m_tree.erase(event.pid);
+                    m_treeIgnored.emplace(event.pid);
+
+                    if (m_loop && app->m_pidfd.isValid() && !app->m_exited)
+                        m_loop->removeFd(app->m_pidfd.get());
+                    app->m_pidfd.reset();
+                    app->m_exited = true;
+                    exited        = true;
+                    break;
+                }
+
+                if (!NAME.empty() && NAME != app->m_class) {
+                    app->m_class = StringPool::intern(NAME);
+                    changed      = true;
+                }
+                break;
+            }
+            case OS::CProcEvents::PROC_EVENT_TYPE_EXIT: {
+                // so its pid is never signaled once recycled
+                if (const auto IT = m_tree.find(event.pid); IT != m_tree.end() && IT->second > 0 && IT->second != event.pid) {
+                    if (const auto OWNER = std::ranges::find(m_apps, IT->second, &CApp::m_pid); OWNER != m_apps.end())
+                        std::erase((*OWNER)->m_descendants, event.pid);
+                }
+
+                m_tree.erase(event.pid);
+                m_treeIgnored.erase(event.pid);
+
+                // apps with a pidfd hear about it through that
+                for (const auto& app : m_apps) {
+                    if (app->m_pid == event.pid && !app->m_pidfd.isValid() && !app->m_exited) {
+                        app->m_exited = true;
+                        exited        = true;
+                    }
+                }
+                break;
+            }
+        }
+    });
+
+    if (!ALIVE) {
+        g_logger->log(LOG_WARN, "Lost proc events, rescanning the process tree instead");
+        if (m_loop)
+            m_loop->removeFd(m_procEvents->fd());
+        m_procEvents.reset();
+    }
+
+    if (added || exited || !ALIVE)
+        rebuildHot();
+
+    if (added && closing())
+        fillWave();
+
+    // events were dropped, catch up once
+    if (!ALIVE)
+        rescanTree();
+
+    // reconcile tells about what it removed itself
+    if (exited && reconcile())
+        return;
+
+    if (added || changed)
+        m_events.changed.emit();
+}
+
+void CAppState::onEventSocket() {
+    const int FD          = m_eventSocket->fd();
+    bool      needsResync = false;
+    bool      dirty       = false;
+
+    const bool ALIVE = m_eventSocket->dispatch([&](std::string_view event, std::string_view data) {
+        if (event == "closewindow") {
+            // socket2 gives us the address without the 0x that j/clients has
+            const auto ADDRESS = HyprlandIPC::parseAddress(data);
+            if (m_clientsInFlight || m_discovering)
+                m_closedDuringRefresh.emplace(ADDRESS);
+
+            removeClient(ADDRESS);
+            m_openedWindows.erase(ADDRESS);
+            dirty = true;
+        } else if (event == "openwindow") {
+            // we need the pid of the new window, which the event doesn't carry. Dormant, it becomes an app: keep what j/clients won't tell.
+            // ADDRESS,WORKSPACENAME,CLASS,TITLE, the title being the only part with commas in it
+            if (m_dormant) {
+                std::array<size_t, 3> commas{};
+                size_t                pos = 0;
+                for (auto& c : commas) {
+                    c   = data.find(',', pos);
+                    pos = c == std::string_view::npos ? c : c + 1;
+                }
+
+                if (pos != std::string_view::npos)
+                    m_openedWindows[HyprlandIPC::parseAddress(data.substr(0, commas[0]))] = {std::string{data.substr(commas[1] + 1, commas[2] - commas[1] - 1)},
+                                                                                           std::string{data.substr(commas[2] + 1)}};
+            }
+
+            needsResync = true;
+        } else if (event == "closelayer") {
+            // layers are tracked by their pid, recheck them
+            dirty = true;
+        }
+    });
+
+    if (!ALIVE) {
+        g_logger->log(LOG_WARN, "Lost the hyprland event socket, falling back to polling");
+        if (m_loop)
+            m_loop->removeFd(FD);
+        m_eventSocket.reset();
+        needsResync = true;
+    }
+
+    // what discovery finds is as old as its j/clients, it'll need a resync then
+    if (needsResync && m_discovering)
+        m_resyncAfterDiscovery = true;
+    else if (needsResync)
+        refreshClients();
+
+    if (dirty)
+        reconcile();
+}
+
+void CAppState::killAllApps() {
+    if (m_dryRun) {
+        g_logger->log(LOG_TRACE, "CAppState::killAllApps: ignoring, dry run");
+        m_events.killed.emit();
+        return;
+    }
+
+    // one write per scope takes everything in it, double-forked daemons included
+    for (const auto& scope : m_scopes) {
+        if (Cgroup::kill(scope.path))
+            continue;
+
+        g_logger->log(LOG_DEBUG, "CAppState::killAllApps: cgroup.kill failed for {}, killing its pids", scope.path);
+        Cgroup::signal(scope.path, SIGKILL);
+    }
+
+    // killed like killApp does, so reconcile and saveHistory count it as the escalation it is
     for (const auto& a : m_apps) {
-        a->quit();
+        m_telemetry.onKilled(*a);
+
+        if (a->m_cgroup.empty())
+            a->kill();
+        a->m_killed = true;
+    }
+
+    // the scopes take a moment to empty. Waited for from the loop, checkKilled tells once they're done
+    m_killDeadline = secondsPassed() + KILL_TIMEOUT;
+    checkKilled();
+}
+
+bool CAppState::killApp(uint64_t id) {
+    const auto IT = std::ranges::find(m_apps, id, &CApp::m_id);
+    if (IT == m_apps.end())
+        return false;
+
+    if (m_dryRun) {
+        g_logger->log(LOG_TRACE, "CAppState::killApp: ignoring, dry run");
+        return true;
+    }
+
+    auto& app = *IT;
+
+    g_logger->log(LOG_DEBUG, "Killing {} on request", app->m_class);
+    app->kill();
+    app->m_killed = true;
+    m_telemetry.onKilled(*app);
+
+    return true;
+}
+
+void CAppState::fillWave() {
+    if (!closing())
+        return;
+
+    const float        NOW = secondsPassed();
+
+    std::vector<CApp*> waiting;
+    size_t             closing = 0;
+
+    for (const auto& app : m_apps) {
+        // killed by a force quit before its turn, there's nothing left to close
+        if (!app->m_quitAt && !app->m_killed)
+            waiting.emplace_back(app.get());
+        else if (!app->m_killed && app->appAlive() && NOW - *app->m_quitAt < escalationFor(*app).reclose)
+            closing++;
+    }
+
+    if (waiting.empty())
+        return;
+
+    if (m_waveSize > 0) {
+        if (closing >= m_waveSize)
+            return;
+
+        // windows first, then layers, then whatever runs in the background.
+        // Within a tier, the ones that usually take the longest go first.
+        std::ranges::stable_sort(waiting, [this](const CApp* a, const CApp* b) {
+            if (a->m_tier != b->m_tier)
+                return a->m_tier < b->m_tier;
+            return m_history.expectedExit(a->m_class).value_or(0) > m_history.expectedExit(b->m_class).value_or(0);
+        });
+        waiting.resize(std::min<size_t>(waiting.size(), m_waveSize - closing));
+
+        g_logger->log(LOG_DEBUG, "Starting a wave of {} apps, {} still closing", waiting.size(), closing);
+    }
+
+    quitApps(waiting);
+}
+
+CAppState::SEscalation CAppState::escalationFor(const CApp& app) const {
+    if (const auto IT = m_classEscalation.find(app.m_class); IT != m_classEscalation.end())
+        return IT->second;
+
+    auto esc = m_escalation;
+
+    // apps that are slow but do exit on their own get the time they usually take, up to twice the timeout
+    if (const auto EXPECTED = m_history.expectedExit(app.m_class); EXPECTED && esc.kill > 0) {
+        const float STRETCH = std::clamp(*EXPECTED * 1.5F / esc.kill, 1.F, 2.F);
+        esc.term *= STRETCH;
+        esc.kill *= STRETCH;
+    }
+
+    return esc;
+}
+
+std::optional<float> CAppState::nextDeadline(const CApp& app) const {
+    if (!app.m_quitAt || app.m_killed)
+        return std::nullopt;
+
+    const auto           ESC = escalationFor(app);
+    std::optional<float> next;
+
+    const auto           consider = [&next](float at) { next = std::min(next.value_or(at), at); };
+
+    if (ESC.reclose > 0)
+        consider(app.m_nextClose);
+    if (ESC.term > 0 && !app.m_termed && app.closesWindow() && app.m_pid > 0)
+        consider(*app.m_quitAt + ESC.term);
+    if (ESC.kill > 0)
+        consider(*app.m_quitAt + ESC.kill);
+
+    return next;
+}
+
+bool CAppState::needsPolling() const {
+    // without socket2 the clients, and without pidfds or inotify the processes, have to be polled
+    if (!m_eventSocket || (!m_scopes.empty() && !m_cgroupEvents.isValid()))
+        return true;
+
+    for (size_t i = 0; i < m_hot.pids.size(); ++i) {
+        if (m_hot.pids[i] > 0 && !(m_hot.flags[i] & HOT_WATCHED))
+            return true;
+    }
+
+    return false;
+}
+
+std::chrono::milliseconds CAppState::tick() {
+    // before anything sends new ones. A lost j/clients would otherwise keep every resync from going out
+    HyprlandIPC::expireRequests();
+
+    // gives up on the scopes of a force quit, if they took too long
+    checkKilled();
+
+    const float NOW = secondsPassed();
+
+    if (closing()) {
+        fillWave();
+
+        std::vector<CApp*> reclose;
+        bool               escalated = false;
+
+        for (const auto& app : m_apps) {
+            if (!app->m_quitAt || app->m_killed || !app->appAlive())
+                continue;
+
+            const auto  ESC   = escalationFor(*app);
+            const float SINCE = NOW - *app->m_quitAt;
+
+            if (ESC.kill > 0 && SINCE >= ESC.kill) {
+                g_logger->log(LOG_DEBUG, "App {} didn't exit within {}s, killing it", app->m_class, ESC.kill);
+                app->kill();
+                app->m_killed = true;
+                m_telemetry.onKilled(*app);
+                escalated = true;
+                continue;
+            }
+
+            if (ESC.term > 0 && SINCE >= ESC.term && !app->m_termed && app->closesWindow() && app->m_pid > 0) {
+                g_logger->log(LOG_DEBUG, "App {} didn't close within {}s, sending SIGTERM", app->m_class, ESC.term);
+                app->sendSignal(SIGTERM);
+                app->signalDescendants(SIGTERM);
+                app->m_termed = true;
+                escalated     = true;
+            }
+
+            if (ESC.reclose > 0 && NOW >= app->m_nextClose)
+                reclose.emplace_back(app.get());
+        }
+
+        if (!reclose.empty()) {
+            g_logger->log(LOG_DEBUG, "Re-closing {} apps", reclose.size());
+            quitApps(reclose);
+        }
+
+        // nothing in m_apps changed, but whoever shows their state wants to know
+        if (escalated)
+            m_events.changed.emit();
+    }
+
+    if (NOW >= m_nextResync) {
+        m_nextResync = NOW + RESYNC_INTERVAL;
+        refreshClients();
+
+        if (m_treeRoot > 0 && !m_procEvents)
+            rescanTree();
+    }
+
+    updateState();
+
+    // sleep until something is due
+    float next = m_nextResync;
+
+    if (needsPolling())
+        next = std::min(next, NOW + POLL_INTERVAL);
+
+    if (m_killDeadline)
+        next = std::min(next, *m_killDeadline);
+
+    for (const auto& app : m_apps) {
+        if (const auto DEADLINE = nextDeadline(*app))
+            next = std::min(next, *DEADLINE);
+    }
+
+    if (const auto EXPIRY = HyprlandIPC::nextExpiry())
+        next = std::min(next, NOW + std::chrono::duration<float>(*EXPIRY - std::chrono::steady_clock::now()).count());
+
+    return std::chrono::milliseconds(std::max<int64_t>(1, std::ceil((next - secondsPassed()) * 1000)));
+}
+
+void CAppState::quitApps(const std::vector<CApp*>& apps) {
+    // hyprland can take a batch of commands in one request, so instead of a round-trip
+    // per window, send all the closewindows together and match the replies back.
+    // Keep batches at a sane size so a single request doesn't get huge.
+    constexpr size_t BATCH_MAX = 64;
+
+    // class, address. An app gets a close per window it still has, and no signal on top
+    std::vector<std::pair<std::string_view, uint64_t>> closing;
+
+    const float                                        NOW = secondsPassed();
+
+    for (const auto& a : apps) {
+        const bool CLOSE = a->closesWindow() && !a->m_windows.empty();
+
+        m_telemetry.onQuit(*a, CLOSE, NOW);
+
+        if (!a->m_quitAt)
+            a->m_quitAt = NOW;
+        a->m_nextClose = NOW + escalationFor(*a).reclose;
+
+        // all of its windows closed, but it's still there. reconcile SIGTERMs those once, that's all they get
+        if (a->closesWindow() && a->m_pid > 0 && a->m_windows.empty())
+            continue;
+
+        if (!CLOSE) {
+            a->quit(); // signals, or a warning for apps we can't close
+            continue;
+        }
+
+        g_logger->log(LOG_TRACE, "CAppState::quitApps: using close for {}, {} windows", a->m_class, a->m_windows.size());
+
+        for (const auto& address : a->m_windows) {
+            closing.emplace_back(a->m_class, address);
+        }
+    }
+
+    for (size_t i = 0; i < closing.size(); i += BATCH_MAX) {
+        const auto  BATCH = std::span{closing}.subspan(i, std::min(BATCH_MAX, closing.size() - i));
+
+        std::string cmd = "[[BATCH]]";
+        for (const auto& [clazz, address] : BATCH) {
+            cmd += std::format("dispatch closewindow address:0x{:x};", address);
+        }
+
+        // the apps might be gone by the time the reply is here, keep what we need to log
+        std::vector<std::string_view> classes;
+        classes.reserve(BATCH.size());
+        for (const auto& [clazz, address] : BATCH) {
+            classes.emplace_back(clazz);
+        }
+
+        HyprlandIPC::getFromSocketAsync(m_loop, cmd, [classes = std::move(classes)](std::expected<std::string_view, std::string> ret) {
+            if (!ret) {
+                for (const auto& c : classes) {
+                    g_logger->log(LOG_ERR, "Failed closing window {}: ipc err", c);
+                }
+                return;
+            }
+
+            // Hyprland's dispatchBatch (src/debug/HyprCtl.cpp) joins the replies in command order, with a "\n\n\n" DELIMITER in between
+            std::vector<std::string> replies;
+            for (const auto& reply : std::views::split(*ret, std::string_view{"\n\n\n"})) {
+                replies.emplace_back(Hyprutils::String::trim(std::string{std::string_view{reply}}));
+            }
+
+            // older ones just concatenate them. No telling which one failed then, only whether any did
+            if (replies.size() != classes.size()) {
+                std::string all;
+                for (const auto& reply : replies) {
+                    all += reply;
+                }
+
+                std::string allOk;
+                for (size_t i = 0; i < classes.size(); ++i) {
+                    allOk += "ok";
+                }
+
+                std::erase_if(all, [](char c) { return std::isspace(sc<unsigned char>(c)); });
+                if (all != allOk)
+                    g_logger->log(LOG_ERR, "Failed closing some of {} windows ({}...): {}", classes.size(), classes.front(), Hyprutils::String::trim(std::string{*ret}));
+                return;
+            }
+
+            for (size_t i = 0; i < replies.size(); ++i) {
+                if (replies[i] != "ok")
+                    g_logger->log(LOG_ERR, "Failed closing window {}: {}", classes[i], replies[i]);
+            }
+        });
     }
 }
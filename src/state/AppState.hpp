@@ -1,16 +1,46 @@
 #pragma once
 
 #include "../helpers/Memory.hpp"
+#include "../helpers/Logger.hpp"
+#include "../helpers/StringPool.hpp"
+#include "../helpers/ProcEvents.hpp"
+#include "EventLoop.hpp"
+#include "HyprlandIPC.hpp"
+#include "Telemetry.hpp"
+#include "ExitHistory.hpp"
 
-#include <glaze/glaze.hpp>
+#include <hyprutils/signal/Signal.hpp>
 
 #include <chrono>
 #include <cstdint>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace HyprlandIPC {
+    struct SHyprClient;
+    struct SHyprLayer;
+};
 
 namespace State {
+    // bench/micro.cpp, to drive reconciliation without a hyprland
+    struct SBenchAccess;
+
+    // close waves go in this order
+    enum eAppTier : uint8_t {
+        APP_TIER_WINDOW = 0,
+        APP_TIER_LAYER,
+        APP_TIER_BACKGROUND, // processes and scopes without a surface
+    };
+
+    // One per process: all of its windows and layers, or a process or scope without any.
+    // Windows and layers of processes we don't know the pid of get one each.
     class CApp {
       public:
-        CApp(glz::generic::object_t& object);
+        CApp(const HyprlandIPC::SHyprClient& client);
+        CApp(const HyprlandIPC::SHyprLayer& layer);
         CApp(const std::string& name, int pid);
         ~CApp() = default;
 
@@ -18,45 +48,289 @@ namespace State {
         CApp(CApp&)       = delete;
         CApp(CApp&&)      = delete;
 
-        bool        appAlive() const;
-        bool        operator==(const glz::generic& object) const;
+        bool                           appAlive() const;
+
+        // signals. Closing windows is CAppState::quitApps' job
+        void                           quit();
+        void                           kill();
+
+        // whether quit() goes through closewindow rather than a signal
+        bool                           closesWindow() const;
+
+        // takes over what another one of the same process has open, before any pidfd is opened
+        void                           merge(const CApp& other);
+
+        // goes through the pidfd if we have one, so a recycled pid never gets signaled
+        bool                           sendSignal(int sig) const;
+        // drops the ones that are gone first
+        void                           signalDescendants(int sig);
+
+        // stable key for this app, never reused
+        uint64_t                       m_id = nextId();
+
+        // addresses of the windows still open, in the order hyprland listed them. Closed ones drop out.
+        std::vector<uint64_t>          m_windows;
+        std::vector<uint64_t>          m_layers;
+        // of the first window, or the layer namespace
+        std::string                    m_title;
+        // interned, see StringPool
+        std::string_view               m_class;
+        int64_t                        m_pid          = -1;
+        bool                           m_xwayland     = false;
+        bool                           m_alwaysUsePid = false;
+        eAppTier                       m_tier         = APP_TIER_BACKGROUND;
+
+        // processes under this one, e.g. a terminal's shell or a browser's renderers. They go with it:
+        // never asked to quit on their own, only signaled when this gets escalated
+        std::vector<int64_t>           m_descendants;
 
-        void        quit();
-        void        kill();
+        // for apps found through --cgroups: the app scope they stand for
+        std::string                    m_cgroup;
 
-        std::string m_address;
-        std::string m_title;
-        std::string m_class;
-        int64_t     m_pid          = -1;
-        bool        m_xwayland     = false;
-        bool        m_alwaysUsePid = false;
+        // set once the pidfd reports the process exited
+        Hyprutils::OS::CFileDescriptor m_pidfd;
+        bool                           m_exited = false;
+
+        // escalation, in secondsPassed() time. Unset until the app is first asked to quit
+        std::optional<float>           m_quitAt;
+        float                          m_nextClose = 0;
+        bool                           m_termed    = false;
+        bool                           m_killed    = false;
+
+      private:
+        static uint64_t nextId();
     };
 
     class CAppState {
       public:
-        CAppState()  = default;
-        ~CAppState() = default;
+        CAppState() = default;
+        ~CAppState();
 
         CAppState(const CAppState&) = delete;
         CAppState(CAppState&)       = delete;
         CAppState(CAppState&&)      = delete;
 
+        // finds every app and starts closing them, blocking until done
         bool                         init();
+        // same, but discovery happens on a thread, and the results come in through the loop.
+        // Needs the loop set. Emits discovered, then changed.
+        void                         initAsync();
+        bool                         discovering() const;
         bool                         updateState();
+        // full j/clients resync, reconciled once the reply is in
+        void                         refreshClients();
         float                        secondsPassed() const;
-        void                         killAllApps() const;
-        void                         reexitApps() const;
+        // secondsPassed() starts over from now, for a daemon that sat dormant since it started
+        void                         restartClock();
+        // a daemon waiting to be armed: everything is found and kept up to date, windows opened since included, but nothing gets closed
+        void                         setDormant(bool dormant);
+        bool                         dormant() const;
+        // doesn't wait for anything, m_events.killed tells once it's done
+        void                         killAllApps();
+        // false if there's no such app
+        bool                         killApp(uint64_t id);
+
+        // runs whatever is due: re-closes, escalations, the periodic resync and polling.
+        // Returns how long until it wants to run again.
+        std::chrono::milliseconds    tick();
+
+        // hooks our fds (socket2) into the loop. Pass nullptr to unhook before the loop goes away.
+        void                         setEventLoop(SP<IEventLoop> loop);
 
         const std::vector<UP<CApp>>& apps() const;
 
-        bool                         m_dryRun = false;
+        CTelemetry&                  telemetry();
+        bool                         writeReport(const std::string& path);
+        // apps still around that had to be signaled count as needing escalation
+        bool                         saveHistory();
+
+        bool                         m_dryRun     = false;
+        bool                         m_useCgroups = false;
+
+        // counted from when an app was first asked to quit, 0 skips a step
+        struct SEscalation {
+            float reclose = 4.5F; // ask again this often
+            float term    = 0.F;  // SIGTERM apps that are otherwise only closewindow'd
+            float kill    = 0.F;  // SIGKILL
+        };
+
+        // how many apps may be closing at once, 0 for all of them. Apps count as closing until they exit,
+        // or for one re-close interval, so one that hangs doesn't hold up the rest.
+        uint32_t                                     m_waveSize = 0;
+
+        SEscalation                                  m_escalation;
+        std::unordered_map<std::string, SEscalation, StringPool::SHash, std::equal_to<>> m_classEscalation;
+
+        struct {
+            // emitted whenever m_apps changes, or an app gets escalated
+            Hyprutils::Signal::CSignalT<> changed;
+            // initAsync is done, false if it failed
+            Hyprutils::Signal::CSignalT<bool> discovered;
+            // killAllApps is done: what it killed is gone, or it gave up waiting
+            Hyprutils::Signal::CSignalT<> killed;
+        } m_events;
 
       private:
+        friend struct SBenchAccess;
+
+        struct SScope {
+            std::string path;
+        };
+
+        // an app found through the children of hyprland
+        struct SCandidate {
+            UP<CApp>             app;
+            std::vector<int64_t> pids; // left out if any of these owns a window or a layer, and belong to it if under one
+        };
+
+        // what discovery finds, kept apart from the state so it can run off the main thread
+        struct SDiscovery {
+            std::vector<UP<CApp>>                                           apps;
+            std::vector<SCandidate>                                         candidates;
+            std::vector<std::pair<uint64_t, int64_t>>                       clients;
+            std::vector<SScope>                                             scopes;
+            // pid, ppid of the candidates
+            std::vector<std::pair<int64_t, int64_t>>                        parents;
+            // the process tree walk: what it saw as pid, owner pairs (see m_tree), and the ignored daemons it skipped
+            int64_t                                                         treeRoot = -1;
+            std::vector<std::pair<int64_t, int64_t>>                        tree;
+            std::vector<int64_t>                                            treeIgnored;
+            std::vector<std::pair<Hyprutils::CLI::eLogLevel, std::string>> log; // logged from the main thread
+            std::optional<std::string>                                      error;
+        };
+
+        void                                  connectEvents();
+        static SDiscovery                     discover(bool useCgroups);
+        static void                           discoverClients(SDiscovery& found);
+        static void                           discoverLayers(SDiscovery& found);
+        static void                           discoverChildren(bool useCgroups, SDiscovery& found);
+        // the candidates that run under an app owning a window or a layer become its descendants, the rest apps of their own
+        static void                           adoptCandidates(SDiscovery& found, SDiscovery& children);
+        static void                           discoverTree(int64_t hlPid, SDiscovery& found);
+        static bool                           discoverCgroups(int64_t hlPid, SDiscovery& found);
+        // merges the windows and layers of one pid into the first app of it, keeping the order
+        static void                           groupByPid(std::vector<UP<CApp>>& apps);
+        bool                                  applyDiscovery(SDiscovery&& found);
+        void                                  onDiscoveryDone();
+        void                                  cancelDiscovery();
+        void                                  refreshScopes();
+        void                                  onCgroupEvents();
+        void                                  drainCgroupEvents() const;
+        void                                  checkKilled();
+
+        void                                  quitApps(const std::vector<CApp*>& apps);
+        // starts as many waiting apps as the wave allows
+        void                                  fillWave();
+        SEscalation                           escalationFor(const CApp& app) const;
+        std::optional<float>                  nextDeadline(const CApp& app) const;
+        bool                                  needsPolling() const;
+        bool                                  applyClients(std::string_view json);
+        // dormant: the clients no app knows about become apps, or join the one of their pid
+        void                                  adoptClients();
+        // not a dry run, and not dormant either
+        bool                                  closing() const;
+        void                                  addClient(uint64_t address, int64_t pid);
+        void                                  removeClient(uint64_t address);
+        bool                                  reconcile();
+        void                                  onEventSocket();
+        void                                  onPidfd(int fd);
+        void                                  watchPidfd(const UP<CApp>& app);
+
+        void                                  startProcEvents();
+        void                                  onProcEvents();
+        // what a rescan found, kept apart from the state so it can run off the main thread like discovery
+        struct STreeScan {
+            struct SSpawned {
+                int64_t     pid   = -1;
+                int64_t     owner = 0;
+                std::string name;
+            };
+
+            std::vector<int64_t>  gone, goneIgnored; // dead now
+            std::vector<SSpawned> spawned;
+        };
+
+        // finds what was spawned under hyprland since we last looked, walking only the part of the tree we know
+        void                                  rescanTree();
+        static STreeScan                      scanTree(int64_t root, std::unordered_map<int64_t, int64_t> tree, std::unordered_set<int64_t> ignored);
+        void                                  applyTreeScan(STreeScan&& scan);
+        void                                  onTreeScanDone();
+        void                                  cancelTreeScan();
+        // false unless it became an app of its own (gone already, an ignored daemon, or it goes with its owner)
+        bool                                  addSpawned(int64_t pid, int64_t owner, const std::string& name);
+
+        // what the per-tick loops read, index aligned with m_apps and rebuilt whenever its size changes.
+        // They walk these flat arrays instead of chasing every CApp, window addresses stay in CApp::m_windows
+        // and are only touched for apps with a nonzero count.
+        enum eHotFlags : uint8_t {
+            HOT_WATCHED  = (1 << 0), // a pidfd or cgroup.events tells us about the exit
+            HOT_EXITED   = (1 << 1),
+            HOT_WINDOWED = (1 << 2), // closed through its windows, whether or not any are left
+        };
+
+        struct {
+            std::vector<int64_t>  pids;
+            std::vector<uint32_t> windows; // still open, only what reconcile has to check against the clients
+            std::vector<uint8_t>  flags;
+        } m_hot;
+
+        void                                  rebuildHot();
+        // CApp::appAlive, off the hot arrays
+        bool                                  hotAlive(size_t idx) const;
+        void                                  markExited(size_t idx);
+
         std::vector<UP<CApp>>                 m_apps;
-        std::vector<int>                      m_pidsTermedNoWindows;
+        std::unordered_set<int64_t>           m_pidsTermedNoWindows;
+
+        // last known j/clients, kept up to date by socket2 events.
+        // Indexed both ways so reconciling is O(apps + clients).
+        std::unordered_map<uint64_t, int64_t> m_clientPids;
+        std::unordered_map<int64_t, uint32_t> m_windowsPerPid;
+
+        // app scopes found through --cgroups, and an inotify on their cgroup.events
+        std::vector<SScope>                   m_scopes;
+        Hyprutils::OS::CFileDescriptor        m_cgroupEvents;
+        // set while a force quit waits for its scopes to empty
+        std::optional<float>                  m_killDeadline;
+
+        // dormant: what openwindow told about windows j/clients doesn't have the class and title of, address -> class, title
+        std::unordered_map<uint64_t, std::pair<std::string, std::string>> m_openedWindows;
+
+        bool                                  m_clientsInFlight = false;
+        float                                 m_nextResync      = 0;
+        std::unordered_set<uint64_t>          m_closedDuringRefresh;
+
+        bool                                  m_discovering          = false;
+        bool                                  m_resyncAfterDiscovery = false;
+        bool                                  m_dormant              = false;
+        std::thread                           m_discoveryThread;
+        UP<SDiscovery>                        m_discovered;
+        // the thread writes to notify once it's done
+        Hyprutils::OS::CFileDescriptor        m_discoveryDone, m_discoveryNotify;
+
+        std::thread                           m_treeScanThread;
+        UP<STreeScan>                         m_treeScanned;
+        Hyprutils::OS::CFileDescriptor        m_treeScanDone, m_treeScanNotify;
+
+        // without --cgroups: everything under hyprland we know of, pid -> the pid of the app it belongs to (itself for apps owning
+        // a window or a layer, 0 for what runs on its own). Kept up to date by proc events, or by rescans without them,
+        // so what gets spawned while we're closing gets closed too
+        int64_t                               m_treeRoot = -1;
+        std::unordered_map<int64_t, int64_t>  m_tree;
+        // ignored daemons, nothing under them is ours either
+        std::unordered_set<int64_t>           m_treeIgnored;
+        UP<OS::CProcEvents>                   m_procEvents;
+
+        UP<HyprlandIPC::CEventSocket>         m_eventSocket;
+        SP<IEventLoop>                        m_loop;
+
+        CTelemetry                            m_telemetry;
+        CExitHistory                          m_history;
 
         std::chrono::steady_clock::time_point m_started = std::chrono::steady_clock::now();
     };
 
     SP<CAppState> state();
+    // swaps state() for a fresh one with the same options, for a daemon going dormant again. The old one must be unhooked from its loop
+    void          resetState();
 };
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "DaemonTrigger.hpp"
+#include "HyprlandIPC.hpp"
+#include "../helpers/Logger.hpp"
+
+#include <cstring>
+#include <string_view>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <hyprutils/memory/Casts.hpp>
+
+using namespace State;
+using namespace Hyprutils::Memory;
+
+static sockaddr_un triggerAddress() {
+    sockaddr_un address = {0};
+    address.sun_family  = AF_UNIX;
+
+    const auto PATH = CDaemonTrigger::path();
+    strncpy(address.sun_path, PATH.c_str(), sizeof(address.sun_path) - 1);
+
+    return address;
+}
+
+CDaemonTrigger::~CDaemonTrigger() {
+    if (!m_path.empty())
+        unlink(m_path.c_str());
+}
+
+std::string CDaemonTrigger::path() {
+    return HyprlandIPC::client().instanceDir() + "/hyprshutdown-daemon.sock";
+}
+
+bool CDaemonTrigger::arm() {
+    Hyprutils::OS::CFileDescriptor fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (!fd.isValid())
+        return false;
+
+    // a daemon that's there answers right away, one that's wedged shouldn't hold up the logout
+    auto t = timeval{.tv_sec = 1, .tv_usec = 0};
+    setsockopt(fd.get(), SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+
+    const auto ADDRESS = triggerAddress();
+
+    // no daemon, which is the usual case
+    if (connect(fd.get(), rc<const sockaddr*>(&ADDRESS), SUN_LEN(&ADDRESS)) < 0)
+        return false;
+
+    constexpr std::string_view ARM = "arm\n";
+    if (write(fd.get(), ARM.data(), ARM.size()) != sc<ssize_t>(ARM.size()))
+        return false;
+
+    char       reply[8] = {0};
+    const auto LEN      = read(fd.get(), reply, sizeof(reply) - 1);
+
+    return LEN > 0 && std::string_view{reply, sc<size_t>(LEN)}.starts_with("ok");
+}
+
+bool CDaemonTrigger::listen() {
+    const auto ADDRESS = triggerAddress();
+
+    Hyprutils::OS::CFileDescriptor fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)};
+    if (!fd.isValid())
+        return false;
+
+    // someone already listening means another daemon is up
+    if (connect(fd.get(), rc<const sockaddr*>(&ADDRESS), SUN_LEN(&ADDRESS)) == 0) {
+        g_logger->log(LOG_ERR, "A hyprshutdown daemon is already running");
+        return false;
+    }
+
+    fd = Hyprutils::OS::CFileDescriptor{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)};
+    if (!fd.isValid())
+        return false;
+
+    unlink(ADDRESS.sun_path);
+
+    if (bind(fd.get(), rc<const sockaddr*>(&ADDRESS), SUN_LEN(&ADDRESS)) < 0 || ::listen(fd.get(), 4) < 0) {
+        g_logger->log(LOG_ERR, "Couldn't listen on {}: {}", ADDRESS.sun_path, strerror(errno));
+        return false;
+    }
+
+    m_fd   = std::move(fd);
+    m_path = ADDRESS.sun_path;
+
+    return true;
+}
+
+int CDaemonTrigger::fd() const {
+    return m_fd.get();
+}
+
+bool CDaemonTrigger::accept() {
+    bool armed = false;
+
+    while (true) {
+        Hyprutils::OS::CFileDescriptor client{accept4(m_fd.get(), nullptr, nullptr, SOCK_CLOEXEC)};
+        if (!client.isValid())
+            break;
+
+        // the other end writes its line before anything else, don't let a silent one block us
+        auto t = timeval{.tv_sec = 0, .tv_usec = 200000};
+        setsockopt(client.get(), SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+
+        char       line[16] = {0};
+        const auto LEN      = read(client.get(), line, sizeof(line) - 1);
+
+        if (LEN <= 0 || !std::string_view{line, sc<size_t>(LEN)}.starts_with("arm"))
+            continue;
+
+        constexpr std::string_view OK = "ok\n";
+        send(client.get(), OK.data(), OK.size(), MSG_NOSIGNAL);
+
+        armed = true;
+    }
+
+    return armed;
+}
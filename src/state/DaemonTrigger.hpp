@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+#include <hyprutils/os/FileDescriptor.hpp>
+
+namespace State {
+    // The socket a --daemon waits on, and a plain hyprshutdown arms it through.
+    // The protocol is one line each way: "arm" and "ok".
+    class CDaemonTrigger {
+      public:
+        CDaemonTrigger() = default;
+        ~CDaemonTrigger();
+
+        CDaemonTrigger(const CDaemonTrigger&) = delete;
+        CDaemonTrigger(CDaemonTrigger&)       = delete;
+        CDaemonTrigger(CDaemonTrigger&&)      = delete;
+
+        // $XDG_RUNTIME_DIR/hypr/$HIS/hyprshutdown-daemon.sock
+        static std::string path();
+
+        // client side: true if a daemon took it, in which case there's nothing left for us to do
+        static bool        arm();
+
+        bool               listen();
+        int                fd() const;
+
+        // accepts whoever is connecting, true if one of them asked to arm
+        bool               accept();
+
+      private:
+        Hyprutils::OS::CFileDescriptor m_fd;
+        std::string                    m_path;
+    };
+};
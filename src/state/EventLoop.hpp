@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+namespace State {
+    // Whatever drives the state (the UI backend) implements this, so the state can hook its fds into the loop
+    class IEventLoop {
+      public:
+        virtual ~IEventLoop() = default;
+
+        // cb is called whenever fd becomes readable
+        virtual void addFd(int fd, std::function<void()>&& cb) = 0;
+        virtual void removeFd(int fd)                          = 0;
+
+        // same, for writable. Independent of the above, an fd can be in both
+        virtual void addWriteFd(int fd, std::function<void()>&& cb) = 0;
+        virtual void removeWriteFd(int fd)                          = 0;
+    };
+};
@@ -0,0 +1,142 @@
+#include "ExitHistory.hpp"
+#include "../helpers/Logger.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <hyprutils/os/FileDescriptor.hpp>
+
+using namespace State;
+
+namespace {
+    // classes not seen in the longest get dropped past this
+    constexpr size_t MAX_CLASSES = 256;
+
+    struct SHistoryFile {
+        uint32_t                version = 1;
+        CExitHistory::CClassMap classes;
+    };
+
+    std::optional<std::filesystem::path> historyPath() {
+        const auto XDG = getenv("XDG_CACHE_HOME");
+        if (XDG && XDG[0] != '\0')
+            return std::filesystem::path{XDG} / "hyprshutdown" / "history.json";
+
+        const auto HOME = getenv("HOME");
+        if (HOME && HOME[0] != '\0')
+            return std::filesystem::path{HOME} / ".cache" / "hyprshutdown" / "history.json";
+
+        return std::nullopt;
+    }
+};
+
+void CExitHistory::load() {
+    const auto PATH = historyPath();
+    if (!PATH)
+        return;
+
+    // it's small, one read is all it takes
+    Hyprutils::OS::CFileDescriptor fd{open(PATH->c_str(), O_RDONLY | O_CLOEXEC)};
+    if (!fd.isValid())
+        return;
+
+    struct stat st;
+    if (fstat(fd.get(), &st) < 0 || st.st_size <= 0)
+        return;
+
+    std::string data;
+    data.resize(st.st_size);
+    if (read(fd.get(), data.data(), data.size()) != st.st_size)
+        return;
+
+    SHistoryFile file;
+    if (glz::read<glz::opts{.error_on_unknown_keys = false}>(file, data) || file.version != 1) {
+        g_logger->log(LOG_WARN, "Ignoring a broken exit history at {}", PATH->string());
+        return;
+    }
+
+    m_classes = std::move(file.classes);
+
+    g_logger->log(LOG_DEBUG, "Loaded the exit history of {} classes", m_classes.size());
+}
+
+bool CExitHistory::save() const {
+    const auto PATH = historyPath();
+    if (!PATH)
+        return false;
+
+    SHistoryFile file;
+    file.classes = m_classes;
+
+    if (file.classes.size() > MAX_CLASSES) {
+        std::vector<std::pair<uint64_t, std::string>> bySeen;
+        bySeen.reserve(file.classes.size());
+        for (const auto& [clazz, history] : file.classes) {
+            bySeen.emplace_back(history.lastSeen, clazz);
+        }
+
+        std::ranges::sort(bySeen);
+        for (size_t i = 0; i < bySeen.size() - MAX_CLASSES; ++i) {
+            file.classes.erase(bySeen[i].second);
+        }
+    }
+
+    const auto JSON = glz::write_json(file);
+    if (!JSON)
+        return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(PATH->parent_path(), ec);
+
+    // never leave a half written file behind
+    const auto TMP = std::filesystem::path{PATH->string() + ".tmp"};
+    {
+        std::ofstream ofs(TMP, std::ios::trunc);
+        if (!ofs.good())
+            return false;
+        ofs << *JSON;
+        if (!ofs.good())
+            return false;
+    }
+
+    std::filesystem::rename(TMP, *PATH, ec);
+    return !ec;
+}
+
+std::optional<float> CExitHistory::expectedExit(std::string_view clazz) const {
+    const auto IT = m_classes.find(clazz);
+    if (IT == m_classes.end() || IT->second.samples == 0)
+        return std::nullopt;
+
+    return IT->second.avgExit;
+}
+
+CExitHistory::SClassHistory& CExitHistory::historyFor(std::string_view clazz) {
+    auto  IT         = m_classes.find(clazz);
+    auto& history    = IT != m_classes.end() ? IT->second : m_classes[std::string{clazz}];
+    history.lastSeen = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return history;
+}
+
+void CExitHistory::recordExit(std::string_view clazz, float seconds) {
+    auto& history = historyFor(clazz);
+
+    // recent sessions matter more, an app update can change a lot
+    constexpr float WEIGHT = 0.3F;
+
+    history.avgExit = history.samples == 0 ? seconds : history.avgExit + WEIGHT * (seconds - history.avgExit);
+    history.samples++;
+}
+
+void CExitHistory::recordEscalation(std::string_view clazz) {
+    historyFor(clazz).escalations++;
+}
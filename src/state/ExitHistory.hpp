@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../helpers/StringPool.hpp"
+
+namespace State {
+    // What previous shutdowns saw from each app class, kept in $XDG_CACHE_HOME/hyprshutdown/history.json
+    class CExitHistory {
+      public:
+        CExitHistory()  = default;
+        ~CExitHistory() = default;
+
+        CExitHistory(const CExitHistory&) = delete;
+        CExitHistory(CExitHistory&)       = delete;
+        CExitHistory(CExitHistory&&)      = delete;
+
+        struct SClassHistory {
+            uint32_t samples     = 0; // exits on their own, which avgExit is made of
+            float    avgExit     = 0; // seconds from the first quit to the exit, moving average
+            uint32_t escalations = 0; // times it needed a SIGTERM or a kill
+            uint64_t lastSeen    = 0; // unix time
+        };
+
+        using CClassMap = std::unordered_map<std::string, SClassHistory, StringPool::SHash, std::equal_to<>>;
+
+        // a missing or broken file is an empty history
+        void                 load();
+        bool                 save() const;
+
+        // seconds this class usually takes to exit on its own
+        std::optional<float> expectedExit(std::string_view clazz) const;
+
+        // an exit on its own, seconds after the first quit
+        void                 recordExit(std::string_view clazz, float seconds);
+        void                 recordEscalation(std::string_view clazz);
+
+      private:
+        SClassHistory&                                 historyFor(std::string_view clazz);
+
+        CClassMap                                      m_classes;
+    };
+};
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/signal.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <format>
@@ -13,7 +14,9 @@
 #include <fstream>
 #include <algorithm>
 #include <charconv>
+#include <chrono>
 #include <csignal>
+#include <mutex>
 
 #include <hyprutils/memory/Casts.hpp>
 #include <hyprutils/utils/ScopeGuard.hpp>
@@ -37,6 +40,16 @@ static std::string getRuntimeDir() {
     return std::string{XDG} + "/hypr";
 }
 
+static sockaddr_un socketAddress(const std::string& his, const std::string_view& name) {
+    sockaddr_un address = {0};
+    address.sun_family  = AF_UNIX;
+
+    const auto PATH = std::format("{}/{}/{}", getRuntimeDir(), his, name);
+    strncpy(address.sun_path, PATH.c_str(), sizeof(address.sun_path) - 1);
+
+    return address;
+}
+
 static std::optional<uint64_t> toUInt64(const std::string_view str) {
     uint64_t value       = 0;
     const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
@@ -45,10 +58,12 @@ static std::optional<uint64_t> toUInt64(const std::string_view str) {
     return value;
 }
 
-std::expected<std::string, std::string> HyprlandIPC::getFromSocket(const std::string& cmd) {
-    static const auto HIS = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+static std::optional<HyprlandIPC::SInstanceData> parseInstance(const std::filesystem::directory_entry& entry);
 
-    if (!HIS || HIS[0] == '\0')
+static std::expected<std::string, std::string> requestSync(const std::string& cmd) {
+    auto& client = HyprlandIPC::client();
+
+    if (!client.valid())
         return std::unexpected("HYPRLAND_INSTANCE_SIGNATURE empty: are we under hyprland?");
 
     const auto SERVERSOCKET = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -61,43 +76,426 @@ std::expected<std::string, std::string> HyprlandIPC::getFromSocket(const std::st
 
     auto socketGuard = Hyprutils::Utils::CScopeGuard([&] { close(SERVERSOCKET); });
 
-    sockaddr_un serverAddress = {0};
-    serverAddress.sun_family  = AF_UNIX;
-
-    std::string socketPath = getRuntimeDir() + "/" + HIS + "/.socket.sock";
-
-    strncpy(serverAddress.sun_path, socketPath.c_str(), sizeof(serverAddress.sun_path) - 1);
+    auto& address = client.requestAddress();
 
-    if (connect(SERVERSOCKET, rc<sockaddr*>(&serverAddress), SUN_LEN(&serverAddress)) < 0)
-        return std::unexpected(std::format("couldn't connect to the hyprland socket at {}", socketPath));
+    if (connect(SERVERSOCKET, rc<const sockaddr*>(&address), SUN_LEN(&address)) < 0)
+        return std::unexpected(std::format("couldn't connect to the hyprland socket at {}", address.sun_path));
 
     auto sizeWritten = write(SERVERSOCKET, cmd.c_str(), cmd.length());
 
     if (sizeWritten < 0)
         return std::unexpected("couldn't write (4)");
 
-    std::string reply        = "";
-    char        buffer[8192] = {0};
+    // a short read doesn't mean the reply is over, only EOF does
+    thread_local HyprlandIPC::CReplyBuffer buffer;
+    buffer.clear();
+
+    switch (buffer.readFrom(SERVERSOCKET)) {
+        case HyprlandIPC::CReplyBuffer::READ_DONE: break;
+        case HyprlandIPC::CReplyBuffer::READ_AGAIN: return std::unexpected("Hyprland IPC didn't respond in time");
+        case HyprlandIPC::CReplyBuffer::READ_ERROR: return std::unexpected("couldn't read (5)");
+    }
+
+    return std::string{buffer.view()};
+}
+
+HyprlandIPC::CHyprlandIPCClient::CHyprlandIPCClient() {
+    const auto HIS = getenv("HYPRLAND_INSTANCE_SIGNATURE");
+
+    if (!HIS || HIS[0] == '\0')
+        return;
+
+    m_his            = HIS;
+    m_instanceDir    = std::format("{}/{}", getRuntimeDir(), m_his);
+    m_requestAddress = socketAddress(m_his, ".socket.sock");
+    m_eventAddress   = socketAddress(m_his, ".socket2.sock");
+}
+
+bool HyprlandIPC::CHyprlandIPCClient::valid() const {
+    return !m_his.empty();
+}
+
+const std::string& HyprlandIPC::CHyprlandIPCClient::instanceDir() const {
+    return m_instanceDir;
+}
+
+const sockaddr_un& HyprlandIPC::CHyprlandIPCClient::requestAddress() const {
+    return m_requestAddress;
+}
+
+const sockaddr_un& HyprlandIPC::CHyprlandIPCClient::eventAddress() const {
+    return m_eventAddress;
+}
+
+std::optional<HyprlandIPC::SInstanceData> HyprlandIPC::CHyprlandIPCClient::instance() {
+    if (!valid())
+        return std::nullopt;
+
+    std::lock_guard<std::mutex> lg(m_mutex);
+
+    if (m_instance)
+        return m_instance;
+
+    std::error_code ec;
+    const auto      ENTRY = std::filesystem::directory_entry{std::filesystem::path{m_instanceDir}, ec};
+    if (ec)
+        return std::nullopt;
+
+    // only cache a good one, the lock file might just not be written yet
+    m_instance = parseInstance(ENTRY);
+
+    return m_instance;
+}
+
+std::string_view HyprlandIPC::CHyprlandIPCClient::commandKey(std::string_view cmd) {
+    if (cmd.starts_with("[[BATCH]]"))
+        return "batch";
+
+    // flags, e.g. j/clients
+    if (const auto SLASH = cmd.find('/'); SLASH != std::string_view::npos && SLASH < cmd.find(' '))
+        cmd.remove_prefix(SLASH + 1);
+
+    auto end = cmd.find(' ');
+
+    // dispatches are only told apart by the dispatcher
+    if (cmd.substr(0, end) == "dispatch" && end != std::string_view::npos)
+        end = cmd.find(' ', end + 1);
+
+    return cmd.substr(0, end);
+}
+
+void HyprlandIPC::CHyprlandIPCClient::record(std::string_view cmd, std::chrono::steady_clock::time_point started, bool ok) {
+    const double MS     = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    const auto   BUCKET = std::ranges::lower_bound(LATENCY_BUCKETS, MS) - LATENCY_BUCKETS.begin();
+    const auto   KEY    = commandKey(cmd);
+
+    // requests can come from the discovery thread too
+    std::lock_guard<std::mutex> lg(m_mutex);
+
+    auto it = m_commands.find(KEY);
+    if (it == m_commands.end())
+        it = m_commands.emplace(std::string{KEY}, SIPCStats{}).first;
+
+    auto& stats = it->second;
+
+    stats.calls++;
+    stats.totalLatency += MS;
+    stats.maxLatency = std::max(stats.maxLatency, MS);
+    stats.histogram[BUCKET]++;
+
+    if (!ok)
+        stats.failures++;
+}
+
+HyprlandIPC::SIPCStats HyprlandIPC::CHyprlandIPCClient::totals() const {
+    std::lock_guard<std::mutex> lg(m_mutex);
+
+    SIPCStats result;
+    for (const auto& [_, s] : m_commands) {
+        result.calls += s.calls;
+        result.failures += s.failures;
+        result.totalLatency += s.totalLatency;
+        result.maxLatency = std::max(result.maxLatency, s.maxLatency);
+        for (size_t i = 0; i < result.histogram.size(); ++i) {
+            result.histogram[i] += s.histogram[i];
+        }
+    }
+
+    return result;
+}
+
+std::map<std::string, HyprlandIPC::SIPCStats> HyprlandIPC::CHyprlandIPCClient::commands() const {
+    std::lock_guard<std::mutex> lg(m_mutex);
+    return {m_commands.begin(), m_commands.end()};
+}
+
+HyprlandIPC::CHyprlandIPCClient& HyprlandIPC::client() {
+    static CHyprlandIPCClient client;
+    return client;
+}
+
+HyprlandIPC::SIPCStats HyprlandIPC::stats() {
+    return client().totals();
+}
+
+std::expected<std::string, std::string> HyprlandIPC::getFromSocket(const std::string& cmd) {
+    const auto STARTED = std::chrono::steady_clock::now();
+    auto       ret     = requestSync(cmd);
+    client().record(cmd, STARTED, ret.has_value());
+    return ret;
+}
+
+uint64_t HyprlandIPC::parseAddress(std::string_view address) {
+    if (address.starts_with("0x"))
+        address.remove_prefix(2);
+
+    uint64_t value       = 0;
+    const auto [ptr, ec] = std::from_chars(address.data(), address.data() + address.size(), value, 16);
+    if (ec != std::errc() || ptr != address.data() + address.size())
+        return 0;
+
+    return value;
+}
+
+HyprlandIPC::CReplyBuffer::eReadResult HyprlandIPC::CReplyBuffer::readFrom(int fd) {
+    constexpr size_t MIN_READ = 16384;
+
+    while (true) {
+        // always keep a byte for the terminator
+        if (m_data.size() < m_size + MIN_READ + 1)
+            m_data.resize(std::max(m_data.size() * 2, m_size + MIN_READ + 1));
+
+        const auto LEN = read(fd, m_data.data() + m_size, m_data.size() - m_size - 1);
+
+        if (LEN > 0) {
+            m_size += LEN;
+            m_data[m_size] = '\0';
+            continue;
+        }
+
+        if (LEN == 0)
+            return READ_DONE;
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return READ_AGAIN;
+
+        return READ_ERROR;
+    }
+}
+
+std::string_view HyprlandIPC::CReplyBuffer::view() const {
+    return {m_data.data(), m_size};
+}
+
+void HyprlandIPC::CReplyBuffer::clear() {
+    m_size = 0;
+    if (!m_data.empty())
+        m_data[0] = '\0';
+}
+
+namespace {
+    // a hyprland that never answers shouldn't hold the request, and whatever waits on it, forever
+    constexpr auto REQUEST_TIMEOUT = std::chrono::seconds(5);
+
+    struct SPendingRequest {
+        Hyprutils::OS::CFileDescriptor        fd;
+        UP<HyprlandIPC::CReplyBuffer>         reply;
+        HyprlandIPC::FReplyCallback           cb;
+        WP<State::IEventLoop>                 loop;
+        std::string                           command;
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    };
+
+    std::vector<UP<SPendingRequest>>              pendingRequests;
+
+    // buffers of finished requests, handed to new ones
+    std::vector<UP<HyprlandIPC::CReplyBuffer>>    freeBuffers;
+
+    void                                          finishRequest(SPendingRequest* request, bool ok, std::string error = "") {
+        if (const auto LOOP = request->loop.lock())
+            LOOP->removeFd(request->fd.get());
+
+        HyprlandIPC::client().record(request->command, request->started, ok);
+
+        // take everything out first: the callback may very well send another request
+        auto cb    = std::move(request->cb);
+        auto reply = std::move(request->reply);
+        std::erase_if(pendingRequests, [request](const auto& e) { return e.get() == request; });
+
+        if (cb) {
+            if (ok)
+                cb(reply->view());
+            else
+                cb(std::unexpected(std::move(error)));
+        }
+
+        reply->clear();
+        freeBuffers.emplace_back(std::move(reply));
+    }
+
+    void onRequestReadable(SPendingRequest* request) {
+        switch (request->reply->readFrom(request->fd.get())) {
+            // hyprland closes the connection once it's written the full reply
+            case HyprlandIPC::CReplyBuffer::READ_DONE: finishRequest(request, true); break;
+            case HyprlandIPC::CReplyBuffer::READ_AGAIN: break; // more later
+            case HyprlandIPC::CReplyBuffer::READ_ERROR: finishRequest(request, false, "couldn't read (5)"); break;
+        }
+    }
+
+};
+
+void HyprlandIPC::expireRequests() {
+    const auto                    NOW = std::chrono::steady_clock::now();
+
+    std::vector<SPendingRequest*> stale;
+    for (const auto& r : pendingRequests) {
+        if (NOW - r->started >= REQUEST_TIMEOUT)
+            stale.emplace_back(r.get());
+    }
+
+    for (const auto& r : stale) {
+        finishRequest(r, false, "Hyprland IPC didn't respond in time");
+    }
+}
+
+void HyprlandIPC::dropRequests() {
+    for (const auto& r : pendingRequests) {
+        if (const auto LOOP = r->loop.lock())
+            LOOP->removeFd(r->fd.get());
 
-    sizeWritten = read(SERVERSOCKET, buffer, 8192);
+        r->reply->clear();
+        freeBuffers.emplace_back(std::move(r->reply));
+    }
+
+    pendingRequests.clear();
+}
 
-    if (sizeWritten < 0) {
-        if (errno == EWOULDBLOCK)
-            return std::unexpected("Hyprland IPC didn't respond in time");
-        return std::unexpected("couldn't read (5)");
+std::optional<std::chrono::steady_clock::time_point> HyprlandIPC::nextExpiry() {
+    std::optional<std::chrono::steady_clock::time_point> next;
+    for (const auto& r : pendingRequests) {
+        if (!next || r->started + REQUEST_TIMEOUT < *next)
+            next = r->started + REQUEST_TIMEOUT;
     }
 
-    reply += std::string(buffer, sizeWritten);
+    return next;
+}
+
+void HyprlandIPC::getFromSocketAsync(const SP<State::IEventLoop>& loop, const std::string& cmd, FReplyCallback&& cb) {
+    if (!loop) {
+        const auto RET = getFromSocket(cmd);
+        if (RET)
+            cb(std::string_view{*RET});
+        else
+            cb(std::unexpected(RET.error()));
+        return;
+    }
+
+    expireRequests();
+
+    auto& client = HyprlandIPC::client();
+
+    if (!client.valid()) {
+        cb(std::unexpected("HYPRLAND_INSTANCE_SIGNATURE empty: are we under hyprland?"));
+        return;
+    }
+
+    Hyprutils::OS::CFileDescriptor fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+
+    if (!fd.isValid()) {
+        cb(std::unexpected("couldn't open a socket (1)"));
+        return;
+    }
+
+    // non-blocking from the start: a compositor with a full backlog fails the connect instead of stalling us
+    if (fcntl(fd.get(), F_SETFL, fcntl(fd.get(), F_GETFL) | O_NONBLOCK) < 0) {
+        cb(std::unexpected("couldn't make the socket non-blocking"));
+        return;
+    }
+
+    auto& address = client.requestAddress();
+
+    if (connect(fd.get(), rc<const sockaddr*>(&address), SUN_LEN(&address)) < 0) {
+        cb(std::unexpected(std::format("couldn't connect to the hyprland socket at {}", address.sun_path)));
+        return;
+    }
 
-    while (sizeWritten == 8192) {
-        sizeWritten = read(SERVERSOCKET, buffer, 8192);
-        if (sizeWritten < 0) {
-            return std::unexpected("couldn't read (5)");
+    // commands are small, they go straight into the socket buffer
+    if (write(fd.get(), cmd.c_str(), cmd.length()) != sc<ssize_t>(cmd.length())) {
+        cb(std::unexpected("couldn't write (4)"));
+        return;
+    }
+
+    auto& request = pendingRequests.emplace_back(makeUnique<SPendingRequest>());
+    request->fd      = std::move(fd);
+    request->cb      = std::move(cb);
+    request->loop    = loop;
+    request->command = HyprlandIPC::CHyprlandIPCClient::commandKey(cmd);
+
+    if (!freeBuffers.empty()) {
+        request->reply = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+    } else
+        request->reply = makeUnique<HyprlandIPC::CReplyBuffer>();
+
+    loop->addFd(request->fd.get(), [raw = request.get()] { onRequestReadable(raw); });
+}
+
+bool HyprlandIPC::CEventSocket::connect() {
+    const auto& client = HyprlandIPC::client();
+
+    if (!client.valid())
+        return false;
+
+    Hyprutils::OS::CFileDescriptor fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+
+    if (!fd.isValid())
+        return false;
+
+    auto& address = client.eventAddress();
+
+    if (::connect(fd.get(), rc<const sockaddr*>(&address), SUN_LEN(&address)) < 0)
+        return false;
+
+    // we only ever read this from the loop, don't block it
+    if (fcntl(fd.get(), F_SETFL, fcntl(fd.get(), F_GETFL) | O_NONBLOCK) < 0)
+        return false;
+
+    m_fd = std::move(fd);
+    m_pending.clear();
+
+    return true;
+}
+
+int HyprlandIPC::CEventSocket::fd() const {
+    return m_fd.get();
+}
+
+bool HyprlandIPC::CEventSocket::dispatch(const std::function<void(std::string_view event, std::string_view data)>& fn) {
+    if (!m_fd.isValid())
+        return false;
+
+    bool alive        = true;
+    char buffer[8192] = {0};
+
+    while (true) {
+        const auto LEN = read(m_fd.get(), buffer, sizeof(buffer));
+
+        if (LEN > 0) {
+            m_pending.append(buffer, LEN);
+            continue;
         }
-        reply += std::string(buffer, sizeWritten);
+
+        if (LEN < 0 && errno == EINTR)
+            continue;
+
+        // EOF or a real error means hyprland is gone or dropped us
+        if (LEN == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            alive = false;
+
+        break;
+    }
+
+    // events are EVENT>>DATA, one per line
+    size_t start = 0;
+    for (size_t end = m_pending.find('\n'); end != std::string::npos; start = end + 1, end = m_pending.find('\n', start)) {
+        const auto LINE = std::string_view{m_pending}.substr(start, end - start);
+        const auto SEP  = LINE.find(">>");
+
+        if (SEP == std::string_view::npos)
+            continue;
+
+        fn(LINE.substr(0, SEP), LINE.substr(SEP + 2));
     }
 
-    return reply;
+    m_pending.erase(0, start);
+
+    if (!alive)
+        m_fd.reset();
+
+    return alive;
 }
 
 static std::optional<HyprlandIPC::SInstanceData> parseInstance(const std::filesystem::directory_entry& entry) {
@@ -139,27 +537,3 @@ static std::optional<HyprlandIPC::SInstanceData> parseInstance(const std::filesy
 
     return data;
 }
-
-std::vector<HyprlandIPC::SInstanceData> HyprlandIPC::instances() {
-    std::vector<SInstanceData> result;
-
-    std::error_code            ec;
-    const auto                 runtimeDir = getRuntimeDir();
-    if (!std::filesystem::exists(runtimeDir, ec) || ec)
-        return result;
-
-    std::filesystem::directory_iterator it(runtimeDir, std::filesystem::directory_options::skip_permission_denied, ec);
-    if (ec)
-        return result;
-
-    for (const auto& el : it) {
-        if (auto instance = parseInstance(el))
-            result.emplace_back(std::move(*instance));
-    }
-
-    std::erase_if(result, [](const auto& el) { return kill(el.pid, 0) != 0 && errno == ESRCH; });
-
-    std::ranges::sort(result, {}, &SInstanceData::time);
-
-    return result;
-}
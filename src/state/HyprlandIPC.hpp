@@ -1,9 +1,23 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <expected>
 #include <cstdint>
 #include <vector>
+#include <functional>
+#include <string_view>
+
+#include <hyprutils/os/FileDescriptor.hpp>
+
+#include <sys/un.h>
+
+#include "../helpers/Memory.hpp"
+#include "EventLoop.hpp"
 
 namespace HyprlandIPC {
     struct SInstanceData {
@@ -13,6 +27,130 @@ namespace HyprlandIPC {
         std::string wlSocket;
     };
 
+    // Growable buffer a reply is read into. Kept around and reused, so steady state requests don't allocate.
+    // The contents are always followed by a null byte, which lets parsers run straight off view().
+    class CReplyBuffer {
+      public:
+        CReplyBuffer()  = default;
+        ~CReplyBuffer() = default;
+
+        CReplyBuffer(const CReplyBuffer&) = delete;
+        CReplyBuffer(CReplyBuffer&)       = delete;
+        CReplyBuffer(CReplyBuffer&&)      = delete;
+
+        enum eReadResult : uint8_t {
+            READ_DONE = 0, // EOF, the reply is complete
+            READ_AGAIN,    // nothing more for now (or a timeout, on blocking sockets)
+            READ_ERROR,
+        };
+
+        // reads until EOF, or until the fd has nothing more for us
+        eReadResult      readFrom(int fd);
+
+        std::string_view view() const;
+        void             clear();
+
+      private:
+        std::vector<char> m_data;
+        size_t            m_size = 0;
+    };
+
+    // socket2 subscriber. Non-blocking, meant to be polled from the event loop.
+    class CEventSocket {
+      public:
+        CEventSocket()  = default;
+        ~CEventSocket() = default;
+
+        CEventSocket(const CEventSocket&) = delete;
+        CEventSocket(CEventSocket&)       = delete;
+        CEventSocket(CEventSocket&&)      = delete;
+
+        bool connect();
+        int  fd() const;
+
+        // reads everything available and calls fn for each complete event.
+        // Returns false if the socket died.
+        bool dispatch(const std::function<void(std::string_view event, std::string_view data)>& fn);
+
+      private:
+        Hyprutils::OS::CFileDescriptor m_fd;
+        std::string                    m_pending;
+    };
+
+    // upper bounds of the latency histogram buckets, in ms. One more bucket past the last catches the rest.
+    constexpr std::array<double, 11> LATENCY_BUCKETS = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250};
+
+    struct SIPCStats {
+        uint64_t                                         calls        = 0;
+        uint64_t                                         failures     = 0;
+        double                                           totalLatency = 0; // ms
+        double                                           maxLatency   = 0; // ms
+        std::array<uint64_t, LATENCY_BUCKETS.size() + 1> histogram    = {};
+    };
+
+    // Everything about our instance, resolved once: HIS, the socket addresses and the instance itself.
+    // Also keeps count of every request made, sync and async, per command. Thread safe.
+    class CHyprlandIPCClient {
+      public:
+        CHyprlandIPCClient();
+        ~CHyprlandIPCClient() = default;
+
+        CHyprlandIPCClient(const CHyprlandIPCClient&) = delete;
+        CHyprlandIPCClient(CHyprlandIPCClient&)       = delete;
+        CHyprlandIPCClient(CHyprlandIPCClient&&)      = delete;
+
+        // false outside of hyprland (no HYPRLAND_INSTANCE_SIGNATURE)
+        bool                                          valid() const;
+
+        // $XDG_RUNTIME_DIR/hypr/$HIS
+        const std::string&                            instanceDir() const;
+
+        const sockaddr_un&                            requestAddress() const;
+        const sockaddr_un&                            eventAddress() const;
+
+        // ours, read from its own lock file instead of scanning every instance
+        std::optional<SInstanceData>                  instance();
+
+        void                                          record(std::string_view cmd, std::chrono::steady_clock::time_point started, bool ok);
+
+        SIPCStats                                     totals() const;
+        // keyed by commandKey()
+        std::map<std::string, SIPCStats>              commands() const;
+
+        // "/dispatch closewindow address:0x1" -> "dispatch closewindow", "[[BATCH]]..." -> "batch"
+        static std::string_view                       commandKey(std::string_view cmd);
+
+      private:
+        std::string                                   m_his;
+        std::string                                   m_instanceDir;
+        sockaddr_un                                   m_requestAddress = {};
+        sockaddr_un                                   m_eventAddress   = {};
+
+        mutable std::mutex                            m_mutex;
+        std::optional<SInstanceData>                  m_instance;
+        std::map<std::string, SIPCStats, std::less<>> m_commands;
+    };
+
+    CHyprlandIPCClient& client();
+
+    // totals over every request made so far
+    SIPCStats           stats();
+
+    // the reply only lives for the duration of the callback
+    using FReplyCallback = std::function<void(std::expected<std::string_view, std::string> reply)>;
+
+    // "0x55d0c4a1e2f0" or "55d0c4a1e2f0" (socket2) -> 0x55d0c4a1e2f0, 0 if it isn't an address
+    uint64_t                                parseAddress(std::string_view address);
+
     std::expected<std::string, std::string> getFromSocket(const std::string& cmd);
-    std::vector<HyprlandIPC::SInstanceData> instances();
+
+    // Like getFromSocket, but never blocks: the reply is read from the loop and cb is called once hyprland closes the connection.
+    // Any number of these can be in flight. Without a loop, this is getFromSocket with a callback.
+    void                                    getFromSocketAsync(const SP<State::IEventLoop>& loop, const std::string& cmd, FReplyCallback&& cb);
+
+    // fails the async requests hyprland didn't answer within 5s. Whoever drives the loop calls this, by nextExpiry() at the latest
+    void                                                 expireRequests();
+    std::optional<std::chrono::steady_clock::time_point> nextExpiry();
+    // forgets every async request in flight, their callbacks are never called
+    void                                                 dropRequests();
 };
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glaze/glaze.hpp>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Typed views of the hyprland replies we read. Only the fields we use are declared,
+// everything else (workspace, geometry, grouping etc.) is skipped without being parsed.
+// string_views point into the reply buffer, so they only live as long as it does.
+namespace HyprlandIPC {
+    struct SHyprClient {
+        std::string_view address;
+        std::string      title;
+        std::string      clazz;
+        int64_t          pid      = -1;
+        bool             xwayland = false;
+    };
+
+    // the bits of a client we need to reconcile state. Nothing in here allocates.
+    struct SHyprClientRef {
+        std::string_view address;
+        int64_t          pid = -1;
+    };
+
+    struct SHyprLayer {
+        std::string_view address;
+        std::string      ns;
+        int64_t          pid = -1;
+    };
+
+    struct SHyprMonitorLayers {
+        std::map<std::string, std::vector<SHyprLayer>> levels;
+    };
+
+    // monitor name -> layers
+    using CHyprLayers = std::map<std::string, SHyprMonitorLayers>;
+
+    constexpr glz::opts PARSE_OPTS = {.error_on_unknown_keys = false};
+
+    // json has to be null terminated, like std::string and CReplyBuffer::view() are
+    template <typename T>
+    std::optional<T> parse(std::string_view json) {
+        T out{};
+        if (glz::read<PARSE_OPTS>(out, json))
+            return std::nullopt;
+        return out;
+    }
+};
+
+template <>
+struct glz::meta<HyprlandIPC::SHyprClient> {
+    using T                     = HyprlandIPC::SHyprClient;
+    static constexpr auto value = glz::object("address", &T::address, "title", &T::title, "class", &T::clazz, "pid", &T::pid, "xwayland", &T::xwayland);
+};
+
+template <>
+struct glz::meta<HyprlandIPC::SHyprClientRef> {
+    using T                     = HyprlandIPC::SHyprClientRef;
+    static constexpr auto value = glz::object("address", &T::address, "pid", &T::pid);
+};
+
+template <>
+struct glz::meta<HyprlandIPC::SHyprLayer> {
+    using T                     = HyprlandIPC::SHyprLayer;
+    static constexpr auto value = glz::object("address", &T::address, "namespace", &T::ns, "pid", &T::pid);
+};
+
+template <>
+struct glz::meta<HyprlandIPC::SHyprMonitorLayers> {
+    using T                     = HyprlandIPC::SHyprMonitorLayers;
+    static constexpr auto value = glz::object("levels", &T::levels);
+};
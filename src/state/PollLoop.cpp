@@ -0,0 +1,48 @@
+#include "PollLoop.hpp"
+
+using namespace State;
+
+void CPollLoop::addFd(int fd, std::function<void()>&& cb) {
+    m_callbacks[fd] = std::move(cb);
+}
+
+void CPollLoop::removeFd(int fd) {
+    m_callbacks.erase(fd);
+}
+
+void CPollLoop::addWriteFd(int fd, std::function<void()>&& cb) {
+    m_writeCallbacks[fd] = std::move(cb);
+}
+
+void CPollLoop::removeWriteFd(int fd) {
+    m_writeCallbacks.erase(fd);
+}
+
+void CPollLoop::dispatch(std::chrono::milliseconds timeout) {
+    m_pollfds.clear();
+    m_pollfds.reserve(m_callbacks.size() + m_writeCallbacks.size());
+    for (const auto& [fd, cb] : m_callbacks) {
+        m_pollfds.emplace_back(pollfd{.fd = fd, .events = POLLIN, .revents = 0});
+    }
+    for (const auto& [fd, cb] : m_writeCallbacks) {
+        m_pollfds.emplace_back(pollfd{.fd = fd, .events = POLLOUT, .revents = 0});
+    }
+
+    if (poll(m_pollfds.data(), m_pollfds.size(), timeout.count()) <= 0)
+        return;
+
+    for (const auto& pfd : m_pollfds) {
+        if (!pfd.revents)
+            continue;
+
+        // an earlier callback might have removed this one
+        auto&      callbacks = pfd.events == POLLOUT ? m_writeCallbacks : m_callbacks;
+        const auto IT        = callbacks.find(pfd.fd);
+        if (IT == callbacks.end())
+            continue;
+
+        // copy: the callback may remove itself
+        auto cb = IT->second;
+        cb();
+    }
+}
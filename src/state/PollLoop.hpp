@@ -0,0 +1,35 @@
+#pragma once
+
+#include "EventLoop.hpp"
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include <poll.h>
+
+namespace State {
+    // Bare poll(2) loop for driving the state without the UI backend
+    class CPollLoop : public IEventLoop {
+      public:
+        CPollLoop()          = default;
+        virtual ~CPollLoop() = default;
+
+        CPollLoop(const CPollLoop&) = delete;
+        CPollLoop(CPollLoop&)       = delete;
+        CPollLoop(CPollLoop&&)      = delete;
+
+        virtual void addFd(int fd, std::function<void()>&& cb);
+        virtual void removeFd(int fd);
+        virtual void addWriteFd(int fd, std::function<void()>&& cb);
+        virtual void removeWriteFd(int fd);
+
+        // waits up to timeout for any fd to become readable (or writable) and runs their callbacks.
+        // Callbacks are free to add and remove fds.
+        void dispatch(std::chrono::milliseconds timeout);
+
+      private:
+        std::unordered_map<int, std::function<void()>> m_callbacks, m_writeCallbacks;
+        std::vector<pollfd>                             m_pollfds;
+    };
+};
@@ -0,0 +1,465 @@
+#include "StatusServer.hpp"
+#include "AppState.hpp"
+#include "HyprlandIPC.hpp"
+#include "IPCTypes.hpp"
+#include "../helpers/Logger.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <hyprutils/memory/Casts.hpp>
+
+using namespace State;
+using namespace Hyprutils::Memory;
+
+namespace {
+    struct SStatusApp {
+        uint64_t    id = 0;
+        std::string clazz;
+        std::string title;
+        int64_t     pid     = -1;
+        size_t      windows = 0;
+        std::string state;
+    };
+
+    struct SStatusEvent {
+        std::string                            event;
+        float                                  elapsed     = 0;
+        bool                                   discovering = false;
+        size_t                                 remaining   = 0;
+        std::optional<std::vector<SStatusApp>> apps;    // status: all of them, update: added or changed
+        std::optional<std::vector<uint64_t>>   removed; // update
+        std::optional<std::string>             result;  // done: "exited" or "cancelled"
+        std::optional<std::string>             message; // error
+    };
+
+    struct SAction {
+        std::string             action;
+        std::optional<uint64_t> id;
+    };
+};
+
+template <>
+struct glz::meta<SStatusApp> {
+    using T                     = SStatusApp;
+    static constexpr auto value = glz::object("id", &T::id, "class", &T::clazz, "title", &T::title, "pid", &T::pid, "windows", &T::windows, "state", &T::state);
+};
+
+namespace {
+    // a client that doesn't read gets dropped before it costs us real memory
+    constexpr size_t MAX_PENDING = 1024 * 1024;
+
+    std::string      appState(const CApp& app) {
+        if (app.m_killed)
+            return "killed";
+        if (app.m_termed)
+            return "terminated";
+        if (app.m_quitAt)
+            return "closing";
+        return "waiting";
+    }
+
+    SStatusApp toStatus(const CApp& app) {
+        return {.id = app.m_id, .clazz = std::string{app.m_class}, .title = app.m_title, .pid = app.m_pid, .windows = app.m_windows.size(), .state = appState(app)};
+    }
+
+    SStatusEvent makeEvent(std::string event) {
+        return {
+            .event       = std::move(event),
+            .elapsed     = state()->secondsPassed(),
+            .discovering = state()->discovering(),
+            .remaining   = state()->apps().size(),
+        };
+    }
+
+    std::string serialize(const SStatusEvent& event) {
+        auto json = glz::write_json(event).value_or("{}");
+        json += '\n';
+        return json;
+    }
+};
+
+CStatusServer::~CStatusServer() {
+    setEventLoop(nullptr);
+
+    // "done" is what clients wait for, give the slow ones a moment to take it
+    flushAll(std::chrono::milliseconds(500));
+
+    if (!m_path.empty())
+        unlink(m_path.c_str());
+}
+
+std::string CStatusServer::defaultPath() {
+    return HyprlandIPC::client().instanceDir() + "/hyprshutdown.sock";
+}
+
+bool CStatusServer::listen(const std::string& path) {
+    sockaddr_un address = {0};
+    address.sun_family  = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        g_logger->log(LOG_ERR, "Status socket path {} is too long", path);
+        return false;
+    }
+
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    Hyprutils::OS::CFileDescriptor fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)};
+    if (!fd.isValid())
+        return false;
+
+    // a previous run that got killed leaves its socket behind
+    unlink(path.c_str());
+
+    if (bind(fd.get(), rc<sockaddr*>(&address), SUN_LEN(&address)) < 0 || ::listen(fd.get(), 8) < 0) {
+        g_logger->log(LOG_ERR, "Couldn't listen on {}: {}", path, strerror(errno));
+        return false;
+    }
+
+    m_listenFd = std::move(fd);
+    m_path     = path;
+
+    g_logger->log(LOG_DEBUG, "Status socket listening on {}", path);
+
+    return true;
+}
+
+bool CStatusServer::addFd(int fd) {
+    if (fcntl(fd, F_GETFD) < 0) {
+        g_logger->log(LOG_ERR, "--status-fd {} isn't open", fd);
+        return false;
+    }
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    auto& client = m_clients.emplace_back(makeUnique<SClient>());
+    client->fd   = Hyprutils::OS::CFileDescriptor{fd};
+
+    int       type   = 0;
+    socklen_t len    = sizeof(type);
+    client->socket   = getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0;
+
+    return true;
+}
+
+void CStatusServer::setEventLoop(SP<IEventLoop> loop) {
+    if (m_loop) {
+        if (m_listenFd.isValid())
+            m_loop->removeFd(m_listenFd.get());
+
+        for (auto& c : m_clients) {
+            if (c->hooked)
+                m_loop->removeFd(c->fd.get());
+            if (c->writeHooked)
+                m_loop->removeWriteFd(c->fd.get());
+            c->hooked      = false;
+            c->writeHooked = false;
+        }
+
+        m_listeners.changed.reset();
+    }
+
+    m_loop = loop;
+
+    if (!m_loop)
+        return;
+
+    if (m_listenFd.isValid())
+        m_loop->addFd(m_listenFd.get(), [this] { onAccept(); });
+
+    m_listeners.changed = state()->m_events.changed.listen([this] { onStateChanged(); });
+
+    // whoever was handed to us before the loop existed starts with the full picture
+    const auto STATUS = fullStatus();
+    m_lastDiscovering = state()->discovering();
+    for (auto& c : m_clients) {
+        hook(*c);
+    }
+
+    broadcast(STATUS);
+}
+
+void CStatusServer::finish(bool closedHyprland) {
+    auto event   = makeEvent("done");
+    event.result = closedHyprland ? "exited" : "cancelled";
+
+    broadcast(serialize(event));
+}
+
+void CStatusServer::hook(SClient& client) {
+    if (!m_loop)
+        return;
+
+    if (!client.hooked) {
+        client.hooked = true;
+        m_loop->addFd(client.fd.get(), [this, fd = client.fd.get()] { onReadable(fd); });
+    }
+
+    // queued before we had a loop
+    if (!client.writeHooked && !client.out.empty()) {
+        client.writeHooked = true;
+        m_loop->addWriteFd(client.fd.get(), [this, fd = client.fd.get()] { onWritable(fd); });
+    }
+}
+
+void CStatusServer::onAccept() {
+    while (true) {
+        const int FD = accept4(m_listenFd.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (FD < 0)
+            break;
+
+        auto& client = m_clients.emplace_back(makeUnique<SClient>());
+        client->fd   = Hyprutils::OS::CFileDescriptor{FD};
+
+        hook(*client);
+
+        if (!send(*client, fullStatus()))
+            dropClient(FD);
+    }
+}
+
+CStatusServer::SClient* CStatusServer::clientFor(int fd) {
+    const auto IT = std::ranges::find_if(m_clients, [fd](const auto& c) { return c->fd.get() == fd; });
+    return IT == m_clients.end() ? nullptr : IT->get();
+}
+
+void CStatusServer::onReadable(int fd) {
+    auto* const CLIENT = clientFor(fd);
+    if (!CLIENT)
+        return;
+
+    auto& client = *CLIENT;
+
+    char  buffer[1024];
+    while (true) {
+        const auto LEN = read(fd, buffer, sizeof(buffer));
+
+        if (LEN > 0) {
+            client.in.append(buffer, LEN);
+            continue;
+        }
+
+        if (LEN < 0 && errno == EINTR)
+            continue;
+
+        if (LEN < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        // a write-only --status-fd can't be read from, but is still worth writing to
+        if (LEN < 0 && errno == EBADF && !client.socket) {
+            m_loop->removeFd(fd);
+            client.hooked = false;
+            return;
+        }
+
+        dropClient(fd);
+        return;
+    }
+
+    if (client.in.size() > MAX_PENDING) {
+        dropClient(fd);
+        return;
+    }
+
+    // actions can end up dropping clients (cancel sends "done" to everyone), so take the lines out first
+    std::vector<std::string> lines;
+    size_t                   start = 0;
+    for (size_t end = client.in.find('\n'); end != std::string::npos; start = end + 1, end = client.in.find('\n', start)) {
+        lines.emplace_back(client.in.substr(start, end - start));
+    }
+
+    client.in.erase(0, start);
+
+    for (const auto& line : lines) {
+        handleLine(fd, line);
+    }
+}
+
+void CStatusServer::handleLine(int fd, const std::string& line) {
+    if (line.empty())
+        return;
+
+    const auto ACTION = HyprlandIPC::parse<SAction>(line);
+
+    const auto reply = [this, fd](std::string message) {
+        auto* const CLIENT = clientFor(fd);
+        if (!CLIENT)
+            return;
+
+        auto event    = makeEvent("error");
+        event.message = std::move(message);
+        if (!send(*CLIENT, serialize(event)))
+            dropClient(fd);
+    };
+
+    if (!ACTION) {
+        reply("bad request");
+        return;
+    }
+
+    g_logger->log(LOG_DEBUG, "Status socket: {}", ACTION->action);
+
+    if (ACTION->action == "cancel")
+        m_events.cancel.emit();
+    else if (ACTION->action == "force-quit")
+        m_events.forceQuit.emit();
+    else if (ACTION->action == "kill") {
+        if (!ACTION->id || !state()->killApp(*ACTION->id))
+            reply("no such app");
+        else
+            onStateChanged(); // it's "killed" now
+    } else
+        reply(std::format("unknown action {}", ACTION->action));
+}
+
+void CStatusServer::onStateChanged() {
+    std::unordered_map<uint64_t, SKnownApp> current;
+    current.reserve(state()->apps().size());
+
+    auto event = makeEvent("update");
+    event.apps.emplace();
+    event.removed.emplace();
+
+    for (const auto& app : state()->apps()) {
+        auto& s = current[app->m_id];
+        s       = {.clazz = app->m_class, .state = appState(*app), .windows = app->m_windows.size()};
+
+        if (const auto IT = m_known.find(app->m_id); IT == m_known.end() || IT->second != s)
+            event.apps->emplace_back(toStatus(*app));
+    }
+
+    for (const auto& [id, _] : m_known) {
+        if (!current.contains(id))
+            event.removed->emplace_back(id);
+    }
+
+    m_known = std::move(current);
+
+    // discovery finishing is worth telling about even if nothing was found, nothing else is
+    if (event.apps->empty() && event.removed->empty() && event.discovering == m_lastDiscovering)
+        return;
+
+    m_lastDiscovering = event.discovering;
+    broadcast(serialize(event));
+}
+
+std::string CStatusServer::fullStatus() const {
+    auto event = makeEvent("status");
+    event.apps.emplace();
+
+    for (const auto& app : state()->apps()) {
+        event.apps->emplace_back(toStatus(*app));
+    }
+
+    return serialize(event);
+}
+
+bool CStatusServer::send(SClient& client, std::string_view json) {
+    client.out.append(json);
+
+    if (!flush(client) || client.out.size() > MAX_PENDING)
+        return false;
+
+    // the rest goes once the client reads
+    if (!client.out.empty() && m_loop && !client.writeHooked) {
+        client.writeHooked = true;
+        m_loop->addWriteFd(client.fd.get(), [this, fd = client.fd.get()] { onWritable(fd); });
+    }
+
+    return true;
+}
+
+bool CStatusServer::flush(SClient& client) {
+    while (!client.out.empty()) {
+        const auto LEN = client.socket ? ::send(client.fd.get(), client.out.data(), client.out.size(), MSG_NOSIGNAL) : write(client.fd.get(), client.out.data(), client.out.size());
+
+        if (LEN > 0) {
+            client.out.erase(0, LEN);
+            continue;
+        }
+
+        if (LEN < 0 && errno == EINTR)
+            continue;
+
+        // kept until it's writable again
+        if (LEN < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        return false;
+    }
+
+    return true;
+}
+
+void CStatusServer::onWritable(int fd) {
+    auto* const CLIENT = clientFor(fd);
+    if (!CLIENT)
+        return;
+
+    if (!flush(*CLIENT)) {
+        dropClient(fd);
+        return;
+    }
+
+    if (!CLIENT->out.empty())
+        return;
+
+    m_loop->removeWriteFd(fd);
+    CLIENT->writeHooked = false;
+}
+
+void CStatusServer::flushAll(std::chrono::milliseconds timeout) {
+    const auto DEADLINE = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        std::vector<pollfd> pfds;
+        for (auto& c : m_clients) {
+            if (!c->out.empty() && flush(*c) && !c->out.empty())
+                pfds.emplace_back(pollfd{.fd = c->fd.get(), .events = POLLOUT, .revents = 0});
+        }
+
+        const auto LEFT = std::chrono::ceil<std::chrono::milliseconds>(DEADLINE - std::chrono::steady_clock::now()).count();
+        if (pfds.empty() || LEFT <= 0)
+            return;
+
+        if (poll(pfds.data(), pfds.size(), sc<int>(LEFT)) < 0 && errno != EINTR)
+            return;
+    }
+}
+
+void CStatusServer::broadcast(const std::string& json) {
+    std::vector<int> dead;
+
+    for (auto& c : m_clients) {
+        if (!send(*c, json))
+            dead.emplace_back(c->fd.get());
+    }
+
+    for (const auto& fd : dead) {
+        dropClient(fd);
+    }
+}
+
+void CStatusServer::dropClient(int fd) {
+    const auto IT = std::ranges::find_if(m_clients, [fd](const auto& c) { return c->fd.get() == fd; });
+    if (IT == m_clients.end())
+        return;
+
+    if (m_loop && (*IT)->hooked)
+        m_loop->removeFd(fd);
+
+    if (m_loop && (*IT)->writeHooked)
+        m_loop->removeWriteFd(fd);
+
+    m_clients.erase(IT);
+}
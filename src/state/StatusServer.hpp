@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../helpers/Memory.hpp"
+#include "EventLoop.hpp"
+
+#include <hyprutils/os/FileDescriptor.hpp>
+#include <hyprutils/signal/Listener.hpp>
+#include <hyprutils/signal/Signal.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace State {
+    // Shutdown progress as newline delimited JSON, for bars and scripts. Served over a unix socket and/or an fd we were handed.
+    // Every client gets a full "status" first, then "update"s with what changed, and a "done" at the end.
+    // Clients can send {"action":"cancel"}, {"action":"force-quit"} or {"action":"kill","id":N}, one per line.
+    class CStatusServer {
+      public:
+        CStatusServer() = default;
+        ~CStatusServer();
+
+        CStatusServer(const CStatusServer&) = delete;
+        CStatusServer(CStatusServer&)       = delete;
+        CStatusServer(CStatusServer&&)      = delete;
+
+        // $XDG_RUNTIME_DIR/hypr/$HIS/hyprshutdown.sock, next to hyprland's own
+        static std::string defaultPath();
+
+        bool               listen(const std::string& path);
+        // takes ownership. Read from too if it's readable, e.g. one end of a socketpair
+        bool               addFd(int fd);
+
+        // hooks our fds into the loop and starts following the state. Pass nullptr to unhook.
+        void               setEventLoop(SP<IEventLoop> loop);
+
+        // last message, once the driver knows how it ends
+        void               finish(bool closedHyprland);
+
+        struct {
+            Hyprutils::Signal::CSignalT<> cancel;
+            Hyprutils::Signal::CSignalT<> forceQuit;
+        } m_events;
+
+      private:
+        struct SClient {
+            Hyprutils::OS::CFileDescriptor fd;
+            bool                           socket      = true;
+            bool                           hooked      = false;
+            bool                           writeHooked = false; // waiting for the fd to take the rest of out
+            std::string                    in, out;
+        };
+
+        // what an update has to tell about, if it changed
+        struct SKnownApp {
+            std::string_view clazz; // interned, changes on exec
+            std::string      state;
+            size_t           windows = 0;
+
+            bool             operator==(const SKnownApp&) const = default;
+        };
+
+        void                                      onAccept();
+        void                                      onReadable(int fd);
+        void                                      onStateChanged();
+        void                                      handleLine(int fd, const std::string& line);
+        SClient*                                  clientFor(int fd);
+
+        void                                      hook(SClient& client);
+        void                                      dropClient(int fd);
+        // queues and flushes what it can, the rest goes once the fd is writable. False if the client is dead or way too far behind
+        bool                                      send(SClient& client, std::string_view json);
+        // writes out what it can without blocking. False if the client is dead
+        bool                                      flush(SClient& client);
+        void                                      onWritable(int fd);
+        // on the way out, nothing would pick it up later. Blocks for up to timeout
+        void                                      flushAll(std::chrono::milliseconds timeout);
+        void                                      broadcast(const std::string& json);
+
+        std::string                               fullStatus() const;
+
+        Hyprutils::OS::CFileDescriptor            m_listenFd;
+        std::string                               m_path;
+        std::vector<UP<SClient>>                  m_clients;
+
+        // app id -> as last sent
+        std::unordered_map<uint64_t, SKnownApp>   m_known;
+        // as last sent, an update with nothing else in it is only worth it when this flips
+        bool                                      m_lastDiscovering = false;
+
+        SP<IEventLoop>                            m_loop;
+
+        struct {
+            Hyprutils::Signal::CHyprSignalListener changed;
+        } m_listeners;
+    };
+};
+
+inline UP<State::CStatusServer> g_statusServer;
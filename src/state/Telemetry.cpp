@@ -0,0 +1,127 @@
+#include "Telemetry.hpp"
+#include "AppState.hpp"
+#include "HyprlandIPC.hpp"
+#include "../helpers/Logger.hpp"
+
+#include <glaze/glaze.hpp>
+
+#include <fstream>
+#include <map>
+
+using namespace State;
+
+namespace {
+    struct SIPCReport {
+        uint64_t              calls        = 0;
+        uint64_t              failures     = 0;
+        double                totalLatency = 0;
+        double                avgLatency   = 0;
+        double                maxLatency   = 0;
+        std::vector<uint64_t> histogram;
+    };
+
+    struct SReport {
+        std::string                         version      = HYPRSHUTDOWN_VERSION;
+        float                               totalSeconds = 0;
+        uint64_t                            timerTicks   = 0;
+        SIPCReport                          ipc;
+        // upper bounds of ipc histogram buckets in ms, the last bucket has none
+        std::vector<double>                 latencyBuckets;
+        std::map<std::string, SIPCReport>   ipcCommands;
+        std::vector<CTelemetry::SAppRecord> apps;
+    };
+
+    SIPCReport toReport(const HyprlandIPC::SIPCStats& stats) {
+        return {
+            .calls        = stats.calls,
+            .failures     = stats.failures,
+            .totalLatency = stats.totalLatency,
+            .avgLatency   = stats.calls ? stats.totalLatency / stats.calls : 0,
+            .maxLatency   = stats.maxLatency,
+            .histogram    = {stats.histogram.begin(), stats.histogram.end()},
+        };
+    }
+};
+
+CTelemetry::SAppRecord& CTelemetry::recordFor(const CApp& app) {
+    auto [it, inserted] = m_records.try_emplace(app.m_id);
+
+    if (inserted) {
+        it->second.className = std::string{app.m_class};
+        it->second.title     = app.m_title;
+        it->second.pid       = app.m_pid;
+        it->second.windows   = app.m_windows.size();
+        m_order.emplace_back(app.m_id);
+    }
+
+    return it->second;
+}
+
+void CTelemetry::onQuit(const CApp& app, bool closewindow, float at) {
+    auto& record = recordFor(app);
+
+    if (!record.firstQuitAt) {
+        record.firstQuitAt = at;
+        record.quitMethod  = closewindow ? "closewindow" : "sigterm";
+        return;
+    }
+
+    record.reexitRounds++;
+}
+
+void CTelemetry::onTermedNoWindows(const CApp& app) {
+    recordFor(app).termedNoWindows = true;
+}
+
+void CTelemetry::onKilled(const CApp& app) {
+    recordFor(app).killed = true;
+}
+
+void CTelemetry::onExited(const CApp& app, float at) {
+    recordFor(app).exitedAt = at;
+}
+
+void CTelemetry::onTick() {
+    m_ticks++;
+}
+
+bool CTelemetry::write(const std::string& path, const std::vector<const CApp*>& remaining, float totalSeconds) {
+    for (const auto& app : remaining) {
+        recordFor(*app);
+    }
+
+    const auto& IPC = HyprlandIPC::client();
+
+    SReport     report;
+    report.totalSeconds   = totalSeconds;
+    report.timerTicks     = m_ticks;
+    report.ipc            = toReport(IPC.totals());
+    report.latencyBuckets = {HyprlandIPC::LATENCY_BUCKETS.begin(), HyprlandIPC::LATENCY_BUCKETS.end()};
+
+    for (const auto& [cmd, stats] : IPC.commands()) {
+        report.ipcCommands.emplace(cmd, toReport(stats));
+    }
+
+    report.apps.reserve(m_order.size());
+    for (const auto& id : m_order) {
+        report.apps.emplace_back(m_records.at(id));
+    }
+
+    const auto JSON = glz::write<glz::opts{.prettify = true}>(report);
+    if (!JSON) {
+        g_logger->log(LOG_ERR, "Failed to serialize the report");
+        return false;
+    }
+
+    std::ofstream ofs(path, std::ios::trunc);
+    if (!ofs.good()) {
+        g_logger->log(LOG_ERR, "Failed to open {} for the report", path);
+        return false;
+    }
+
+    ofs << *JSON;
+
+    g_logger->log(LOG_DEBUG, "Wrote the shutdown report to {}", path);
+
+    return true;
+}
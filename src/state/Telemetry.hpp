@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace State {
+    class CApp;
+
+    // Records how the shutdown went per app, for --report
+    class CTelemetry {
+      public:
+        CTelemetry()  = default;
+        ~CTelemetry() = default;
+
+        CTelemetry(const CTelemetry&) = delete;
+        CTelemetry(CTelemetry&)       = delete;
+        CTelemetry(CTelemetry&&)      = delete;
+
+        struct SAppRecord {
+            std::string          className;
+            std::string          title;
+            int64_t              pid     = -1;
+            size_t               windows = 0; // when first seen
+            std::string          quitMethod; // "closewindow" or "sigterm", empty if never asked
+            std::optional<float> firstQuitAt;
+            uint32_t             reexitRounds    = 0;
+            bool                 termedNoWindows = false;
+            bool                 killed          = false;
+            std::optional<float> exitedAt;
+        };
+
+        // all times are State::state()->secondsPassed()
+        void onQuit(const CApp& app, bool closewindow, float at);
+        void onTermedNoWindows(const CApp& app);
+        void onKilled(const CApp& app);
+        void onExited(const CApp& app, float at);
+        void onTick();
+
+        // apps still in `remaining` are reported as never having exited
+        bool write(const std::string& path, const std::vector<const CApp*>& remaining, float totalSeconds);
+
+      private:
+        SAppRecord&                              recordFor(const CApp& app);
+
+        std::unordered_map<uint64_t, SAppRecord> m_records;
+        std::vector<uint64_t>                    m_order; // first seen first
+        uint64_t                                 m_ticks = 0;
+    };
+};
@@ -0,0 +1,48 @@
+#include "AppListModel.hpp"
+#include "../state/AppState.hpp"
+
+#include <format>
+#include <unordered_set>
+
+void CAppListModel::sync(const std::vector<UP<State::CApp>>& apps) {
+    std::unordered_set<uint64_t> current;
+    current.reserve(apps.size());
+    for (const auto& APP : apps) {
+        current.emplace(APP->m_id);
+    }
+
+    bool changed = false;
+
+    // apps only ever go away or show up at the end, so the rest keep their order
+    std::erase_if(m_rows, [this, &current, &changed](const auto& row) {
+        if (current.contains(row->id))
+            return false;
+
+        m_byId.erase(row->id);
+        changed = true;
+        return true;
+    });
+
+    for (const auto& APP : apps) {
+        auto& row = m_byId[APP->m_id];
+        if (!row)
+            row = m_rows.emplace_back(makeShared<SRow>(SRow{.id = APP->m_id}));
+
+        // an exec can rename it, closed windows lower the count
+        if (row->clazz == APP->m_class && row->windows == APP->m_windows.size() && !row->titleMarkup.empty())
+            continue;
+
+        row->clazz       = APP->m_class;
+        row->windows     = APP->m_windows.size();
+        row->classLabel  = row->windows > 1 ? std::format("{} ×{}", row->clazz, row->windows) : std::string{row->clazz};
+        row->titleMarkup = std::format("<i>{}</i>", APP->m_title);
+        changed          = true;
+    }
+
+    if (changed)
+        m_events.updated.emit();
+}
+
+const std::vector<SP<CAppListModel::SRow>>& CAppListModel::rows() const {
+    return m_rows;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <hyprutils/signal/Signal.hpp>
+
+#include "../helpers/Memory.hpp"
+
+namespace State {
+    class CApp;
+};
+
+// The app list as shown, shared by every monitor. One row per app, which is a process: its windows show as a count
+// ("firefox ×14") instead of a row each. Derived strings are made once here, monitors only build elements for what they show.
+class CAppListModel {
+  public:
+    CAppListModel()  = default;
+    ~CAppListModel() = default;
+
+    CAppListModel(const CAppListModel&) = delete;
+    CAppListModel(CAppListModel&)       = delete;
+    CAppListModel(CAppListModel&&)      = delete;
+
+    struct SRow {
+        uint64_t         id = 0; // the app's, CApp::m_id
+        std::string_view clazz;  // interned
+        size_t           windows = 0;
+        std::string      classLabel;
+        std::string      titleMarkup;
+    };
+
+    // follows the state's apps, emits updated if any row was added, removed or changed
+    void                         sync(const std::vector<UP<State::CApp>>& apps);
+
+    // in the state's order
+    const std::vector<SP<SRow>>& rows() const;
+
+    struct {
+        Hyprutils::Signal::CSignalT<> updated;
+    } m_events;
+
+  private:
+    std::vector<SP<SRow>>                  m_rows;
+    std::unordered_map<uint64_t, SP<SRow>> m_byId;
+};
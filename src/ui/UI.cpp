@@ -2,14 +2,20 @@
 #include "../helpers/Logger.hpp"
 #include "../state/AppState.hpp"
 #include "../state/HyprlandIPC.hpp"
+#include "../state/EventLoop.hpp"
+#include "../state/StatusServer.hpp"
 
 #include <algorithm>
+#include <format>
+#include <unordered_map>
 
 #include <hyprtoolkit/core/Output.hpp>
 #include <hyprtoolkit/types/SizeType.hpp>
 #include <hyprutils/memory/SharedPtr.hpp>
 #include <hyprutils/os/Process.hpp>
 
+#include <poll.h>
+
 using namespace Hyprutils::OS;
 
 namespace {
@@ -18,6 +24,10 @@ namespace {
     constexpr float kButtonFontScale       = 0.40F;
     constexpr float kButtonCharWidthFactor = 0.6F;
 
+    // more than fit the list on any sane output, the rest is a page away.
+    // Keeps element count (and its layout and memory) independent of how many apps there are
+    constexpr size_t ROWS_PER_PAGE = 32;
+
     float           buttonWidthForLabel(std::string_view label, float padding, float fontSize) {
         const float textWidth = static_cast<float>(label.size()) * (fontSize * kButtonCharWidthFactor);
         return textWidth + (std::max(0.F, padding) * 2.F);
@@ -44,25 +54,107 @@ namespace {
 
         return btn;
     }
+
+    class CBackendLoop : public State::IEventLoop {
+      public:
+        CBackendLoop(WP<Hyprtoolkit::IBackend> backend) : m_backend(backend) {
+            ;
+        }
+
+        virtual void addFd(int fd, std::function<void()>&& cb) {
+            if (m_backend)
+                m_backend->addFd(fd, std::move(cb));
+        }
+
+        virtual void removeFd(int fd) {
+            if (m_backend)
+                m_backend->removeFd(fd);
+        }
+
+        // the backend only watches fds for reading. Writability is polled for instead, and only while someone waits on it
+        virtual void addWriteFd(int fd, std::function<void()>&& cb) {
+            m_writers->callbacks[fd] = std::move(cb);
+            armWriteTimer();
+        }
+
+        virtual void removeWriteFd(int fd) {
+            m_writers->callbacks.erase(fd);
+        }
+
+      private:
+        struct SWriters {
+            std::unordered_map<int, std::function<void()>> callbacks;
+            ASP<Hyprtoolkit::CTimer>                        timer;
+        };
+
+        void armWriteTimer() {
+            if (!m_backend || m_writers->timer || m_writers->callbacks.empty())
+                return;
+
+            // the timer can outlive us, it only gets to the writers while we're around
+            m_writers->timer = m_backend->addTimer(
+                std::chrono::milliseconds(20),
+                [this, writers = WP<SWriters>{m_writers}](ASP<Hyprtoolkit::CTimer> timer, void* d) {
+                    if (writers)
+                        onWriteTimer();
+                },
+                nullptr);
+        }
+
+        void onWriteTimer() {
+            m_writers->timer.reset();
+
+            std::vector<pollfd> pfds;
+            pfds.reserve(m_writers->callbacks.size());
+            for (const auto& [fd, cb] : m_writers->callbacks) {
+                pfds.emplace_back(pollfd{.fd = fd, .events = POLLOUT, .revents = 0});
+            }
+
+            if (poll(pfds.data(), pfds.size(), 0) > 0) {
+                for (const auto& pfd : pfds) {
+                    // an earlier callback might have removed this one
+                    const auto IT = m_writers->callbacks.find(pfd.fd);
+                    if (!pfd.revents || IT == m_writers->callbacks.end())
+                        continue;
+
+                    // copy: the callback may remove itself
+                    auto cb = IT->second;
+                    cb();
+                }
+            }
+
+            armWriteTimer();
+        }
+
+        WP<Hyprtoolkit::IBackend> m_backend;
+        SP<SWriters>              m_writers = makeShared<SWriters>();
+    };
+}
+
+static std::string subTextLabel() {
+    if (State::state()->discovering())
+        return "Looking for running apps...";
+
+    return "Waiting for your apps to exit.\n<i>You can force quit Hyprland, but that risks losing unsaved progress.</i>";
 }
 
 CUI::CUI()  = default;
 CUI::~CUI() = default;
 
-CMonitorState::SAppListApp::SAppListApp(const std::string_view& clazz, const std::string_view& title) {
+CMonitorState::SAppListApp::SAppListApp() {
     m_null = Hyprtoolkit::CNullBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_PERCENT, Hyprtoolkit::CDynamicSize::HT_SIZE_AUTO, {1.F, 1.F}})->commence();
     m_null->setMargin(4);
     m_layout =
         Hyprtoolkit::CColumnLayoutBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_PERCENT, Hyprtoolkit::CDynamicSize::HT_SIZE_AUTO, {1.F, 1.F}})->gap(2)->commence();
 
     m_title = Hyprtoolkit::CTextBuilder::begin()
-                  ->text(std::format("<i>{}</i>", title))
+                  ->text("")
                   ->color([] { return g_ui->backend()->getPalette()->m_colors.text; })
                   ->fontSize(Hyprtoolkit::CFontSize{Hyprtoolkit::CFontSize::HT_FONT_TEXT})
                   ->commence();
 
     m_class = Hyprtoolkit::CTextBuilder::begin()
-                  ->text(std::string{clazz})
+                  ->text("")
                   ->color([] { return g_ui->backend()->getPalette()->m_colors.text; })
                   ->fontSize(Hyprtoolkit::CFontSize{Hyprtoolkit::CFontSize::HT_FONT_H3})
                   ->commence();
@@ -87,6 +179,20 @@ CMonitorState::SAppListApp::SAppListApp(const std::string_view& clazz, const std
     m_null->addChild(m_layout);
 }
 
+void CMonitorState::SAppListApp::set(const CAppListModel::SRow& row) {
+    m_id = row.id;
+
+    if (m_shownClass != row.classLabel) {
+        m_shownClass = row.classLabel;
+        m_class->rebuild()->text(std::string{m_shownClass})->commence();
+    }
+
+    if (m_shownTitle != row.titleMarkup) {
+        m_shownTitle = row.titleMarkup;
+        m_title->rebuild()->text(std::string{m_shownTitle})->commence();
+    }
+}
+
 CMonitorState::CMonitorState(SP<Hyprtoolkit::IOutput> output) : m_monitorName(output->port()) {
     m_window = Hyprtoolkit::CWindowBuilder::begin()
                    ->type(Hyprtoolkit::HT_WINDOW_LAYER)
@@ -121,7 +227,7 @@ CMonitorState::CMonitorState(SP<Hyprtoolkit::IOutput> output) : m_monitorName(ou
                     ->commence();
 
     m_subText = Hyprtoolkit::CTextBuilder::begin()
-                    ->text("Waiting for your apps to exit.\n<i>You can force quit Hyprland, but that risks losing unsaved progress.</i>")
+                    ->text(subTextLabel())
                     ->color([] { return g_ui->backend()->getPalette()->m_colors.text; })
                     ->fontSize(Hyprtoolkit::CFontSize{Hyprtoolkit::CFontSize::HT_FONT_TEXT})
                     ->commence();
@@ -149,6 +255,23 @@ CMonitorState::CMonitorState(SP<Hyprtoolkit::IOutput> output) : m_monitorName(ou
     m_appListLayout =
         Hyprtoolkit::CColumnLayoutBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_PERCENT, Hyprtoolkit::CDynamicSize::HT_SIZE_AUTO, {1, 1}})->gap(8)->commence();
 
+    m_pageLayout =
+        Hyprtoolkit::CRowLayoutBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_PERCENT, Hyprtoolkit::CDynamicSize::HT_SIZE_AUTO, {1, 1}})->gap(5)->commence();
+    m_pageLayout->setMargin(4);
+
+    m_pageText = Hyprtoolkit::CTextBuilder::begin()
+                     ->text("")
+                     ->color([] { return g_ui->backend()->getPalette()->m_colors.text; })
+                     ->fontSize(Hyprtoolkit::CFontSize{Hyprtoolkit::CFontSize::HT_FONT_TEXT})
+                     ->commence();
+
+    m_prevPage = makeButton("Previous", [this](auto) { showPage(m_page - 1); }, 4.F);
+    m_nextPage = makeButton("Next", [this](auto) { showPage(m_page + 1); }, 4.F);
+
+    m_pageLayout->addChild(m_prevPage);
+    m_pageLayout->addChild(m_pageText);
+    m_pageLayout->addChild(m_nextPage);
+
     m_buttonLayout =
         Hyprtoolkit::CRowLayoutBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_PERCENT, Hyprtoolkit::CDynamicSize::HT_SIZE_AUTO, {1, 1}})->gap(5)->commence();
     auto spacer3 = Hyprtoolkit::CNullBuilder::begin()->size({Hyprtoolkit::CDynamicSize::HT_SIZE_ABSOLUTE, Hyprtoolkit::CDynamicSize::HT_SIZE_ABSOLUTE, {1.F, 1.F}})->commence();
@@ -156,13 +279,8 @@ CMonitorState::CMonitorState(SP<Hyprtoolkit::IOutput> output) : m_monitorName(ou
 
     m_buttonLayout->addChild(spacer3);
 
-    m_forceQuit = makeButton(
-        "Force quit",
-        [](auto) {
-            State::state()->killAllApps();
-            g_ui->exit(true);
-        },
-        8.F);
+    // exits once the state says everything's gone, see m_listeners.killed
+    m_forceQuit = makeButton("Force quit", [](auto) { State::state()->killAllApps(); }, 8.F);
 
     m_cancel = makeButton("Cancel", [](auto) { g_ui->exit(false); }, 8.F);
 
@@ -185,20 +303,92 @@ CMonitorState::CMonitorState(SP<Hyprtoolkit::IOutput> output) : m_monitorName(ou
     m_layout->addChild(m_spacer2);
     m_layout->addChild(m_buttonLayout);
 
-    update();
+    syncRows();
+
+    m_listeners.listUpdated = g_ui->m_appList->m_events.updated.listen([this] { syncRows(); });
 
     m_window->open();
 }
 
-void CMonitorState::update() {
-    m_apps.clear();
-    m_appListLayout->clearChildren();
+void CMonitorState::updateSubText() {
+    m_subText->rebuild()->text(subTextLabel())->commence();
+}
 
-    const auto& APPS = State::state()->apps();
+void CMonitorState::showPage(size_t page) {
+    // m_page - 1 on the first page wraps, that's no page either
+    const size_t PAGES = (g_ui->m_appList->rows().size() + ROWS_PER_PAGE - 1) / ROWS_PER_PAGE;
+    if (page >= PAGES || page == m_page)
+        return;
 
-    for (const auto& APP : APPS) {
-        m_apps.emplace_back(makeUnique<SAppListApp>(APP->m_class, APP->m_title));
-        m_appListLayout->addChild(m_apps.back()->m_null);
+    m_page = page;
+    syncRows();
+}
+
+void CMonitorState::syncRows() {
+    const auto&  ROWS  = g_ui->m_appList->rows();
+    const size_t PAGES = std::max<size_t>(1, (ROWS.size() + ROWS_PER_PAGE - 1) / ROWS_PER_PAGE);
+
+    // apps exiting can take the page we're on away
+    m_page = std::min(m_page, PAGES - 1);
+
+    const size_t FIRST = m_page * ROWS_PER_PAGE;
+    const size_t LAST  = std::min(ROWS.size(), FIRST + ROWS_PER_PAGE);
+
+    std::unordered_map<uint64_t, const CAppListModel::SRow*> visible;
+    visible.reserve(LAST - FIRST);
+    for (size_t i = FIRST; i < LAST; ++i) {
+        visible.emplace(ROWS[i]->id, ROWS[i].get());
+    }
+
+    // out of view or gone: park the elements
+    std::erase_if(m_apps, [this, &visible](auto& app) {
+        if (visible.contains(app->m_id))
+            return false;
+
+        m_appListLayout->removeChild(app->m_null);
+        m_freeApps.emplace_back(std::move(app));
+        return true;
+    });
+
+    // the model keeps its order and only appends, so usually what's left is the start of the page and whatever came into view goes after it.
+    // Not after a page change backwards, those rows go first: lay the page out again
+    bool inOrder = true;
+    for (size_t i = 0; i < m_apps.size() && inOrder; ++i) {
+        inOrder = m_apps[i]->m_id == ROWS[FIRST + i]->id;
+    }
+
+    if (!inOrder) {
+        for (auto& app : m_apps) {
+            m_appListLayout->removeChild(app->m_null);
+            m_freeApps.emplace_back(std::move(app));
+        }
+        m_apps.clear();
+    }
+
+    for (const auto& app : m_apps) {
+        app->set(*visible.at(app->m_id));
+    }
+
+    if (m_pagerShown) {
+        m_appListLayout->removeChild(m_pageLayout);
+        m_pagerShown = false;
+    }
+
+    for (size_t i = FIRST + m_apps.size(); i < LAST; ++i) {
+        if (m_freeApps.empty())
+            m_freeApps.emplace_back(makeUnique<SAppListApp>());
+
+        auto& app = m_apps.emplace_back(std::move(m_freeApps.back()));
+        m_freeApps.pop_back();
+
+        app->set(*ROWS[i]);
+        m_appListLayout->addChild(app->m_null);
+    }
+
+    if (PAGES > 1) {
+        m_pageText->rebuild()->text(std::format("<i>{}-{} of {}</i>", FIRST + 1, LAST, ROWS.size()))->commence();
+        m_appListLayout->addChild(m_pageLayout);
+        m_pagerShown = true;
     }
 }
 
@@ -208,9 +398,29 @@ void CUI::registerOutput(const SP<Hyprtoolkit::IOutput>& mon) {
 }
 
 void CUI::exit(bool closeHl) {
+    if (m_exiting)
+        return;
+
+    m_exiting   = true;
+    m_cancelled = !closeHl;
+
+    if (g_statusServer)
+        g_statusServer->finish(closeHl);
+
     g_ui->m_states.clear();
 
+    // a daemon keeps its backend up for the next time
+    if (m_trigger && m_cancelled && !m_failed) {
+        g_ui->backend()->addIdle([this] { disarm(); });
+        return;
+    }
+
     g_ui->backend()->addIdle([this, closeHl] {
+        if (g_statusServer)
+            g_statusServer->setEventLoop(nullptr);
+
+        State::state()->setEventLoop(nullptr);
+
         g_ui->m_backend->destroy();
         g_ui->m_backend.reset();
 
@@ -225,37 +435,117 @@ void CUI::exit(bool closeHl) {
     });
 }
 
-void CUI::setTimer() {
-    // every 5 seconds or so, attempt to sigterm apps again
-    static uint16_t          counter     = 0;
-    constexpr const uint16_t COUNTER_MAX = 30;
+void CUI::disarm() {
+    g_logger->log(LOG_DEBUG, "Cancelled, going dormant again");
+
+    if (g_statusServer)
+        g_statusServer->setEventLoop(nullptr);
+
+    m_listeners.newMon.reset();
+    m_listeners.stateChanged.reset();
+    m_listeners.discovered.reset();
+    m_listeners.killed.reset();
+    m_listeners.statusCancel.reset();
+    m_listeners.statusForceQuit.reset();
+
+    m_appList.reset();
+    m_dirty = false;
+
+    // the state only lasts one shutdown, what was asked to close stays asked otherwise
+    State::state()->setEventLoop(nullptr);
+    State::resetState();
+    m_loop.reset();
+
+    m_armed     = false;
+    m_exiting   = false;
+    m_cancelled = false;
+
+    State::state()->setDormant(true);
+    startState();
+}
+
+void CUI::onDiscovered(bool ok) {
+    if (!ok) {
+        g_logger->log(LOG_ERR, "Failed to init state");
+        m_failed = true;
+        exit(false);
+        return;
+    }
+
+    for (const auto& s : m_states) {
+        s->updateSubText();
+    }
+}
+
+void CUI::onStateChanged() {
+    // dormant: nothing's shown, and no apps doesn't mean we're done
+    if (m_exiting || !m_armed)
+        return;
+
+    // bursts (e.g. a wave of pidfds) land here many times per iteration, only look at the result once
+    m_dirty = true;
+    scheduleUpdate();
+}
+
+void CUI::scheduleUpdate() {
+    if (m_updateScheduled)
+        return;
+
+    m_updateScheduled = true;
+
+    const auto NOW = std::chrono::steady_clock::now();
+    const auto DUE = m_lastUpdate + m_updateInterval;
+
+    if (NOW >= DUE) {
+        m_backend->addIdle([this] { applyUpdate(); });
+        return;
+    }
+
+    m_coalesceTimer = m_backend->addTimer(
+        std::chrono::ceil<std::chrono::milliseconds>(DUE - NOW), [this](ASP<Hyprtoolkit::CTimer> timer, void* d) { applyUpdate(); }, nullptr);
+}
+
+void CUI::applyUpdate() {
+    m_updateScheduled = false;
+
+    if (m_exiting || !m_armed || !m_dirty)
+        return;
+
+    m_dirty      = false;
+    m_lastUpdate = std::chrono::steady_clock::now();
+
+    // nothing found yet doesn't mean nothing is running
+    if (State::state()->discovering())
+        return;
+
+    if (State::state()->apps().empty()) {
+        exit(true);
+        return;
+    }
+
+    m_appList->sync(State::state()->apps());
+}
 
+void CUI::setTimer(std::chrono::milliseconds in) {
     m_updateTimer = m_backend->addTimer(
-        std::chrono::milliseconds(150),
+        in,
         [this](ASP<Hyprtoolkit::CTimer> timer, void* d) {
-            if (State::state()->apps().empty()) {
-                exit(true);
+            // a daemon going dormant again starts over
+            if (m_exiting) {
+                m_ticking = false;
                 return;
             }
 
-            counter++;
-
-            if (counter > COUNTER_MAX) {
-                g_logger->log(LOG_DEBUG, "Re-closing apps");
-                counter = 0;
-                State::state()->reexitApps();
+            if (m_armed && State::state()->apps().empty() && !State::state()->discovering()) {
+                exit(true);
+                return;
             }
 
-            if (!State::state()->updateState()) {
-                setTimer();
-                return; // no changes
-            }
+            State::state()->telemetry().onTick();
 
-            for (const auto& s : m_states) {
-                s->update();
-            }
-
-            setTimer();
+            // the state knows when its next re-close or escalation is due.
+            // Changes are picked up through the changed signal.
+            setTimer(State::state()->tick());
         },
         nullptr);
 }
@@ -270,6 +560,41 @@ bool CUI::run() {
     if (!m_backend)
         return false;
 
+    if (m_trigger) {
+        // fonts, outputs and everything else the backend needs are loaded by now, and the state is kept up to date while we wait.
+        // Arming is only building the windows and starting to close what's already known
+        State::state()->setDormant(true);
+        startState();
+
+        m_backend->addFd(m_trigger->fd(), [this] {
+            if (m_trigger->accept())
+                arm();
+        });
+
+        g_logger->log(LOG_DEBUG, "Dormant, waiting to be armed through {}", State::CDaemonTrigger::path());
+    } else
+        arm();
+
+    m_backend->enterLoop();
+
+    return !m_failed;
+}
+
+void CUI::arm() {
+    if (m_armed)
+        return;
+
+    m_armed = true;
+
+    g_logger->log(LOG_DEBUG, "Armed");
+
+    // the shutdown starts now, not at exec-once
+    State::state()->restartClock();
+    State::state()->setDormant(false);
+
+    m_appList = makeUnique<CAppListModel>();
+    m_appList->sync(State::state()->apps());
+
     {
         const auto MONITORS = m_backend->getOutputs();
 
@@ -281,12 +606,45 @@ bool CUI::run() {
 
         g_logger->log(LOG_DEBUG, "Found {} output(s)", MONITORS.size());
 
-        setTimer();
+        // a daemon started it already
+        startState();
+
+        if (g_statusServer) {
+            m_listeners.statusCancel    = g_statusServer->m_events.cancel.listen([this] { exit(false); });
+            m_listeners.statusForceQuit = g_statusServer->m_events.forceQuit.listen([] { State::state()->killAllApps(); });
+            g_statusServer->setEventLoop(m_loop);
+        }
     }
 
-    m_backend->enterLoop();
+    // a warm state may well have nothing left to close
+    if (!State::state()->discovering())
+        onStateChanged();
+}
+
+void CUI::startState() {
+    if (m_loop)
+        return;
+
+    m_listeners.stateChanged = State::state()->m_events.changed.listen([this] { onStateChanged(); });
+    m_listeners.discovered   = State::state()->m_events.discovered.listen([this](bool ok) { onDiscovered(ok); });
+    m_listeners.killed       = State::state()->m_events.killed.listen([this] { exit(true); });
+
+    m_loop = makeShared<CBackendLoop>(m_backend);
+    State::state()->setEventLoop(m_loop);
+
+    // the overlay is up (or will be, once armed), find what to close in the background
+    State::state()->initAsync();
+
+    // ticks whatever state() is, a daemon going dormant again keeps the one it had
+    if (m_ticking)
+        return;
+
+    m_ticking = true;
+    setTimer(std::chrono::milliseconds(150));
+}
 
-    return true;
+bool CUI::cancelled() const {
+    return m_cancelled;
 }
 
 SP<Hyprtoolkit::IBackend> CUI::backend() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 
 #include <hyprtoolkit/core/Backend.hpp>
@@ -16,6 +17,9 @@
 #include <hyprutils/signal/Listener.hpp>
 
 #include "../helpers/Memory.hpp"
+#include "AppListModel.hpp"
+#include "../state/DaemonTrigger.hpp"
+#include "../state/EventLoop.hpp"
 
 class CMonitorState {
   public:
@@ -26,10 +30,11 @@ class CMonitorState {
     CMonitorState(CMonitorState&)       = delete;
     CMonitorState(CMonitorState&&)      = delete;
 
-    void        update();
-
     std::string m_monitorName;
 
+    // "looking for apps" until discovery is done
+    void        updateSubText();
+
   private:
     SP<Hyprtoolkit::IWindow>              m_window;
 
@@ -46,9 +51,20 @@ class CMonitorState {
     SP<Hyprtoolkit::CRectangleElement>    m_appListRect;
     SP<Hyprtoolkit::CScrollAreaElement>   m_appListScroll;
     SP<Hyprtoolkit::CColumnLayoutElement> m_appListLayout;
+    // past ROWS_PER_PAGE, the list is paged
+    SP<Hyprtoolkit::CRowLayoutElement>    m_pageLayout;
+    SP<Hyprtoolkit::CTextElement>         m_pageText;
+    SP<Hyprtoolkit::CButtonElement>       m_prevPage, m_nextPage;
 
     struct SAppListApp {
-        SAppListApp(const std::string_view& clazz, const std::string_view& title);
+        SAppListApp();
+
+        // shows row, only touching the texts that changed
+        void                                  set(const CAppListModel::SRow& row);
+
+        // CAppListModel::SRow::id this shows
+        uint64_t                              m_id = 0;
+        std::string                           m_shownClass, m_shownTitle;
 
         SP<Hyprtoolkit::CNullElement>         m_null, m_titleNull, m_classNull;
         SP<Hyprtoolkit::CColumnLayoutElement> m_layout;
@@ -56,7 +72,21 @@ class CMonitorState {
         SP<Hyprtoolkit::CTextElement>         m_class;
     };
 
+    // brings the shown rows in line with the model, reusing row elements
+    void                         syncRows();
+    // ignored if there's no such page
+    void                         showPage(size_t page);
+
+    // shown rows of m_page, in model order. Never more than ROWS_PER_PAGE
     std::vector<UP<SAppListApp>> m_apps;
+    // row elements that went out of view, for reuse
+    std::vector<UP<SAppListApp>> m_freeApps;
+    size_t                       m_page       = 0;
+    bool                         m_pagerShown = false;
+
+    struct {
+        Hyprutils::Signal::CHyprSignalListener listUpdated;
+    } m_listeners;
 };
 
 class CUI {
@@ -67,23 +97,63 @@ class CUI {
     bool                       run();
     SP<Hyprtoolkit::IBackend>  backend();
 
+    // the overlay went away without closing hyprland
+    bool                       cancelled() const;
+
     bool                       m_noExit = false;
     std::optional<std::string> m_postExitCmd;
     std::string                m_shutdownLabel;
 
+    // state changes within this are applied to the overlay together. 0 is once per loop iteration
+    std::chrono::milliseconds  m_updateInterval = std::chrono::milliseconds(16);
+
+    // --daemon: run() brings the backend up, but shows nothing until this is triggered
+    UP<State::CDaemonTrigger>  m_trigger;
+
   private:
+    // shows the overlay and starts closing apps
+    void                           arm();
+    // hooks the state into the loop and finds what's running. Before arming already for a daemon
+    void                           startState();
+    // a cancelled daemon: back to dormant, with a fresh state
+    void                           disarm();
     void                           registerOutput(const SP<Hyprtoolkit::IOutput>& mon);
-    void                           setTimer();
+    void                           setTimer(std::chrono::milliseconds in);
+    void                           onStateChanged();
+    void                           scheduleUpdate();
+    void                           applyUpdate();
+    void                           onDiscovered(bool ok);
 
     void                           exit(bool closeHl = false);
 
     SP<Hyprtoolkit::IBackend>      m_backend;
+    SP<State::IEventLoop>          m_loop;
     ASP<Hyprtoolkit::CTimer>       m_updateTimer;
+    ASP<Hyprtoolkit::CTimer>       m_coalesceTimer;
 
     std::vector<UP<CMonitorState>> m_states;
 
+    // shared by all of m_states
+    UP<CAppListModel>              m_appList;
+
+    bool                           m_armed     = false;
+    bool                           m_exiting   = false;
+    bool                           m_failed    = false;
+    bool                           m_cancelled = false;
+    bool                           m_ticking   = false;
+
+    // set by every state change, cleared once the overlay caught up
+    bool                                  m_dirty           = false;
+    bool                                  m_updateScheduled = false;
+    std::chrono::steady_clock::time_point m_lastUpdate;
+
     struct {
         Hyprutils::Signal::CHyprSignalListener newMon;
+        Hyprutils::Signal::CHyprSignalListener stateChanged;
+        Hyprutils::Signal::CHyprSignalListener discovered;
+        Hyprutils::Signal::CHyprSignalListener killed;
+        Hyprutils::Signal::CHyprSignalListener statusCancel;
+        Hyprutils::Signal::CHyprSignalListener statusForceQuit;
     } m_listeners;
 
     friend class CMonitorState;